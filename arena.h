@@ -0,0 +1,87 @@
+/**
+ * A bump allocator for the memtable. Memory is carved out of large blocks and only freed
+ * all at once with the arena, so an allocation is a pointer increment most of the time.
+ * Concurrent writers share the arena without a lock: they bump the offset of the current block
+ * atomically, and the first one to find it full installs the next block with a compare-and-swap.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+class Arena {
+public:
+    Arena() = default;
+
+    Arena(const Arena &) = delete;
+
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena() {
+        Block *block = blocks_.load(std::memory_order_acquire);
+        while (block != nullptr) {
+            Block *next = block->next_;
+            delete block;
+            block = next;
+        }
+    }
+
+    // memory aligned for any of the memtable nodes
+    char *allocate(size_t bytes) {
+        // every size is a multiple of the alignment, so every offset in a block is aligned
+        const size_t align = alignof(std::max_align_t);
+        bytes = (bytes + align - 1U) / align * align;
+        // large objects get a block of their own, so that the rest of the current block is not wasted
+        if (bytes > BLOCK_SIZE / 4U) {
+            return push(new Block(bytes))->data_.get();
+        }
+        Block *current = current_.load(std::memory_order_acquire);
+        while (true) {
+            if (current != nullptr) {
+                const size_t offset = current->used_.fetch_add(bytes, std::memory_order_relaxed);
+                if (offset + bytes <= BLOCK_SIZE) {
+                    return current->data_.get() + offset;
+                }
+            }
+            // the block is full, the rest of it is left unused
+            auto next = std::make_unique<Block>(BLOCK_SIZE);
+            if (current_.compare_exchange_strong(current, next.get(), std::memory_order_acq_rel)) {
+                current = push(next.release());
+            }
+            // otherwise another writer installed a block first, current is now that one
+        }
+    }
+
+    // bytes of the blocks held by the arena
+    [[nodiscard]] size_t get_memory_usage() const { return usage_.load(std::memory_order_relaxed); }
+
+    static constexpr size_t BLOCK_SIZE = 64U * 1024U; // 64KB
+
+private:
+    struct Block {
+        explicit Block(size_t size) : data_(new char[size]), size_(size) {}
+
+        // operator new[] returns memory aligned for any fundamental type
+        std::unique_ptr<char[]> data_;
+        std::atomic<size_t> used_{0U};
+        size_t size_{0U};
+        // blocks are kept in a list, freed with the arena
+        Block *next_{nullptr};
+    };
+
+    std::atomic<Block *> current_{nullptr};
+    std::atomic<Block *> blocks_{nullptr};
+    std::atomic<size_t> usage_{0U};
+
+    Block *push(Block *block) {
+        block->next_ = blocks_.load(std::memory_order_relaxed);
+        while (!blocks_.compare_exchange_weak(block->next_, block, std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+        }
+        (void) usage_.fetch_add(block->size_ + sizeof(Block), std::memory_order_relaxed);
+        return block;
+    }
+};
@@ -0,0 +1,367 @@
+#include "art.h"
+
+#include <cstring>
+#include <mutex>
+#include <new>
+
+AdaptiveRadixTree::AdaptiveRadixTree() {
+    reset();
+}
+
+AdaptiveRadixTree::~AdaptiveRadixTree() = default;
+
+void AdaptiveRadixTree::reset() {
+    MemTable::reset();
+    tree = std::make_shared<Tree>();
+}
+
+AdaptiveRadixTree::Child *AdaptiveRadixTree::find_child(Inner *node, uint8_t byte) {
+    switch (node->type_) {
+        case Type::NODE4: {
+            auto *n = static_cast<Node4 *>(node);
+            for (int i = 0; i < n->count_; ++i) {
+                if (n->keys_[i] == byte) {
+                    return &n->children_[i];
+                }
+            }
+            return nullptr;
+        }
+        case Type::NODE16: {
+            auto *n = static_cast<Node16 *>(node);
+            for (int i = 0; i < n->count_; ++i) {
+                if (n->keys_[i] == byte) {
+                    return &n->children_[i];
+                }
+            }
+            return nullptr;
+        }
+        case Type::NODE48: {
+            auto *n = static_cast<Node48 *>(node);
+            return n->index_[byte] != 0U ? &n->children_[n->index_[byte] - 1U] : nullptr;
+        }
+        case Type::NODE256:
+        default: {
+            auto *n = static_cast<Node256 *>(node);
+            return n->children_[byte] != 0U ? &n->children_[byte] : nullptr;
+        }
+    }
+}
+
+AdaptiveRadixTree::Child AdaptiveRadixTree::next_child(const Inner *node, unsigned &byte) {
+    switch (node->type_) {
+        case Type::NODE4: {
+            auto *n = static_cast<const Node4 *>(node);
+            for (int i = 0; i < n->count_; ++i) {
+                if (n->keys_[i] >= byte) {
+                    byte = n->keys_[i];
+                    return n->children_[i];
+                }
+            }
+            return 0U;
+        }
+        case Type::NODE16: {
+            auto *n = static_cast<const Node16 *>(node);
+            for (int i = 0; i < n->count_; ++i) {
+                if (n->keys_[i] >= byte) {
+                    byte = n->keys_[i];
+                    return n->children_[i];
+                }
+            }
+            return 0U;
+        }
+        case Type::NODE48: {
+            auto *n = static_cast<const Node48 *>(node);
+            for (unsigned b = byte; b < 256U; ++b) {
+                if (n->index_[b] != 0U) {
+                    byte = b;
+                    return n->children_[n->index_[b] - 1U];
+                }
+            }
+            return 0U;
+        }
+        case Type::NODE256:
+        default: {
+            auto *n = static_cast<const Node256 *>(node);
+            for (unsigned b = byte; b < 256U; ++b) {
+                if (n->children_[b] != 0U) {
+                    byte = b;
+                    return n->children_[b];
+                }
+            }
+            return 0U;
+        }
+    }
+}
+
+void AdaptiveRadixTree::add_child(Child *ref, uint8_t byte, Child child) {
+    Inner *node = as_inner(*ref);
+    switch (node->type_) {
+        case Type::NODE4: {
+            auto *n = static_cast<Node4 *>(node);
+            if (n->count_ < 4U) {
+                int i = n->count_;
+                for (; i > 0 && n->keys_[i - 1] > byte; --i) {
+                    n->keys_[i] = n->keys_[i - 1];
+                    n->children_[i] = n->children_[i - 1];
+                }
+                n->keys_[i] = byte;
+                n->children_[i] = child;
+                ++n->count_;
+                return;
+            }
+            auto *grown = new_node<Node16>();
+            std::memcpy(grown->prefix_, n->prefix_, sizeof(n->prefix_));
+            grown->prefix_length_ = n->prefix_length_;
+            grown->count_ = n->count_;
+            std::memcpy(grown->keys_, n->keys_, sizeof(n->keys_));
+            std::memcpy(grown->children_, n->children_, sizeof(n->children_));
+            *ref = reinterpret_cast<Child>(grown);
+            break;
+        }
+        case Type::NODE16: {
+            auto *n = static_cast<Node16 *>(node);
+            if (n->count_ < 16U) {
+                int i = n->count_;
+                for (; i > 0 && n->keys_[i - 1] > byte; --i) {
+                    n->keys_[i] = n->keys_[i - 1];
+                    n->children_[i] = n->children_[i - 1];
+                }
+                n->keys_[i] = byte;
+                n->children_[i] = child;
+                ++n->count_;
+                return;
+            }
+            auto *grown = new_node<Node48>();
+            std::memcpy(grown->prefix_, n->prefix_, sizeof(n->prefix_));
+            grown->prefix_length_ = n->prefix_length_;
+            grown->count_ = n->count_;
+            for (int i = 0; i < n->count_; ++i) {
+                grown->index_[n->keys_[i]] = static_cast<uint8_t>(i + 1);
+                grown->children_[i] = n->children_[i];
+            }
+            *ref = reinterpret_cast<Child>(grown);
+            break;
+        }
+        case Type::NODE48: {
+            auto *n = static_cast<Node48 *>(node);
+            if (n->count_ < 48U) {
+                // children are never removed, so the used slots are the first count_ ones
+                n->children_[n->count_] = child;
+                n->index_[byte] = static_cast<uint8_t>(n->count_ + 1U);
+                ++n->count_;
+                return;
+            }
+            auto *grown = new_node<Node256>();
+            std::memcpy(grown->prefix_, n->prefix_, sizeof(n->prefix_));
+            grown->prefix_length_ = n->prefix_length_;
+            grown->count_ = n->count_;
+            for (unsigned b = 0U; b < 256U; ++b) {
+                if (n->index_[b] != 0U) {
+                    grown->children_[b] = n->children_[n->index_[b] - 1U];
+                }
+            }
+            *ref = reinterpret_cast<Child>(grown);
+            break;
+        }
+        case Type::NODE256:
+        default: {
+            auto *n = static_cast<Node256 *>(node);
+            n->children_[byte] = child;
+            ++n->count_;
+            return;
+        }
+    }
+    // the node grew, add the child to the larger one
+    add_child(ref, byte, child);
+}
+
+AdaptiveRadixTree::Slot *AdaptiveRadixTree::find(uint64_t key) const {
+    std::shared_lock<std::shared_mutex> lock(tree->mutex_);
+    Child child = tree->root_;
+    int depth = 0;
+    while (child != 0U) {
+        if (is_leaf(child)) {
+            Leaf *leaf = as_leaf(child);
+            return leaf->key_ == key ? &leaf->record_ : nullptr;
+        }
+        Inner *node = as_inner(child);
+        for (int i = 0; i < node->prefix_length_; ++i) {
+            if (node->prefix_[i] != byte_at(key, depth + i)) {
+                return nullptr;
+            }
+        }
+        depth += node->prefix_length_;
+        Child *next = find_child(node, byte_at(key, depth));
+        if (next == nullptr) {
+            return nullptr;
+        }
+        child = *next;
+        ++depth;
+    }
+    return nullptr;
+}
+
+AdaptiveRadixTree::Slot *AdaptiveRadixTree::insert(uint64_t key, const Record *record, bool &inserted) {
+    std::unique_lock<std::shared_mutex> lock(tree->mutex_);
+    Child *ref = &tree->root_;
+    int depth = 0;
+    while (true) {
+        const Child child = *ref;
+        if (child == 0U) {
+            break;
+        }
+        if (is_leaf(child)) {
+            if (as_leaf(child)->key_ == key) {
+                inserted = false;
+                return &as_leaf(child)->record_;
+            }
+            // split the leaf into a node holding both keys, prefixed by the bytes they share
+            const uint64_t existing = as_leaf(child)->key_;
+            int p = depth;
+            while (byte_at(existing, p) == byte_at(key, p)) {
+                ++p;
+            }
+            auto *node = new_node<Node4>();
+            node->prefix_length_ = static_cast<uint8_t>(p - depth);
+            for (int i = 0; i < node->prefix_length_; ++i) {
+                node->prefix_[i] = byte_at(key, depth + i);
+            }
+            auto split = reinterpret_cast<Child>(node);
+            add_child(&split, byte_at(existing, p), child);
+            Leaf *leaf = new_leaf(key, record);
+            add_child(&split, byte_at(key, p), reinterpret_cast<Child>(leaf) | 1U);
+            *ref = split;
+            inserted = true;
+            ++tree->version_;
+            return &leaf->record_;
+        }
+        Inner *node = as_inner(child);
+        int i = 0;
+        while (i < node->prefix_length_ && node->prefix_[i] == byte_at(key, depth + i)) {
+            ++i;
+        }
+        if (i < node->prefix_length_) {
+            // the key leaves the prefix, split it at the first byte that differs
+            auto *parent = new_node<Node4>();
+            parent->prefix_length_ = static_cast<uint8_t>(i);
+            std::memcpy(parent->prefix_, node->prefix_, i);
+            const uint8_t byte = node->prefix_[i];
+            node->prefix_length_ = static_cast<uint8_t>(node->prefix_length_ - i - 1);
+            std::memmove(node->prefix_, node->prefix_ + i + 1, node->prefix_length_);
+            auto split = reinterpret_cast<Child>(parent);
+            add_child(&split, byte, child);
+            Leaf *leaf = new_leaf(key, record);
+            add_child(&split, byte_at(key, depth + i), reinterpret_cast<Child>(leaf) | 1U);
+            *ref = split;
+            inserted = true;
+            ++tree->version_;
+            return &leaf->record_;
+        }
+        depth += node->prefix_length_;
+        Child *next = find_child(node, byte_at(key, depth));
+        if (next == nullptr) {
+            Leaf *leaf = new_leaf(key, record);
+            add_child(ref, byte_at(key, depth), reinterpret_cast<Child>(leaf) | 1U);
+            inserted = true;
+            ++tree->version_;
+            return &leaf->record_;
+        }
+        ref = next;
+        ++depth;
+    }
+    Leaf *leaf = new_leaf(key, record);
+    *ref = reinterpret_cast<Child>(leaf) | 1U;
+    inserted = true;
+    ++tree->version_;
+    return &leaf->record_;
+}
+
+std::unique_ptr<::Iterator> AdaptiveRadixTree::iterator() const {
+    return std::make_unique<Iterator>(arena, tree);
+}
+
+void AdaptiveRadixTree::Iterator::seek(uint64_t target) {
+    std::shared_lock<std::shared_mutex> lock(tree_->mutex_);
+    search(target);
+}
+
+void AdaptiveRadixTree::Iterator::next() {
+    std::shared_lock<std::shared_mutex> lock(tree_->mutex_);
+    if (version_ == tree_->version_) {
+        advance();
+    } else if (current_->key_ == UINT64_MAX) {
+        current_ = nullptr;
+    } else {
+        search(current_->key_ + 1U);
+    }
+}
+
+void AdaptiveRadixTree::Iterator::search(uint64_t target) {
+    version_ = tree_->version_;
+    depth_ = 0U;
+    current_ = nullptr;
+    Child child = tree_->root_;
+    if (child == 0U) {
+        return;
+    }
+    int depth = 0;
+    while (!is_leaf(child)) {
+        const Inner *node = as_inner(child);
+        // every key of the subtree is either greater or less than the target if the prefix differs
+        for (int i = 0; i < node->prefix_length_; ++i) {
+            const uint8_t byte = byte_at(target, depth + i);
+            if (node->prefix_[i] > byte) {
+                descend(child);
+                return;
+            }
+            if (node->prefix_[i] < byte) {
+                advance();
+                return;
+            }
+        }
+        depth += node->prefix_length_;
+        const unsigned byte = byte_at(target, depth);
+        unsigned found = byte;
+        child = next_child(node, found);
+        if (child == 0U) {
+            advance();
+            return;
+        }
+        path_[depth_++] = {node, found};
+        if (found != byte) {
+            descend(child);
+            return;
+        }
+        ++depth;
+    }
+    current_ = as_leaf(child);
+    if (current_->key_ < target) {
+        advance();
+    }
+}
+
+void AdaptiveRadixTree::Iterator::descend(Child child) {
+    // inner nodes have at least two children
+    while (!is_leaf(child)) {
+        const Inner *node = as_inner(child);
+        unsigned byte = 0U;
+        child = next_child(node, byte);
+        path_[depth_++] = {node, byte};
+    }
+    current_ = as_leaf(child);
+}
+
+void AdaptiveRadixTree::Iterator::advance() {
+    while (depth_ > 0U) {
+        Frame &frame = path_[depth_ - 1U];
+        unsigned byte = frame.byte_ + 1U;
+        const Child child = next_child(frame.node_, byte);
+        if (child != 0U) {
+            frame.byte_ = byte;
+            descend(child);
+            return;
+        }
+        --depth_;
+    }
+    current_ = nullptr;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "memtable.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <shared_mutex>
+
+/**
+ * An adaptive radix tree over the 8 big-endian bytes of the keys, see https://db.in.tum.de/~leis/papers/ART.pdf
+ * Inner nodes grow from 4 to 16, 48 and 256 children, a subtree holding one key is a leaf,
+ * and the bytes shared by every key of a subtree are stored once as the prefix of its root.
+ * Writers hold a lock over the whole tree, readers share it. Nodes outgrown or split stay in the arena.
+ */
+class AdaptiveRadixTree : public MemTable {
+    struct Leaf {
+        uint64_t key_;
+        Slot record_;
+    };
+
+    enum class Type : uint8_t {
+        NODE4, NODE16, NODE48, NODE256
+    };
+
+    // a leaf if the lowest bit is set, an inner node otherwise
+    typedef uintptr_t Child;
+
+    struct Inner {
+        Type type_;
+        uint8_t prefix_length_{0U};
+        uint16_t count_{0U};
+        uint8_t prefix_[8]{};
+
+        explicit Inner(Type type) : type_(type) {}
+    };
+
+    // children sorted by key byte
+    struct Node4 : Inner {
+        uint8_t keys_[4]{};
+        Child children_[4]{};
+
+        Node4() : Inner(Type::NODE4) {}
+    };
+
+    struct Node16 : Inner {
+        uint8_t keys_[16]{};
+        Child children_[16]{};
+
+        Node16() : Inner(Type::NODE16) {}
+    };
+
+    // index_ maps a key byte to its child slot + 1, 0 if there is none
+    struct Node48 : Inner {
+        uint8_t index_[256]{};
+        Child children_[48]{};
+
+        Node48() : Inner(Type::NODE48) {}
+    };
+
+    struct Node256 : Inner {
+        Child children_[256]{};
+
+        Node256() : Inner(Type::NODE256) {}
+    };
+
+    // the root and the lock, shared with the iterators so that they outlive a reset
+    struct Tree {
+        std::shared_mutex mutex_;
+        Child root_{0U};
+        // bumped by every insert of a key, which may grow, split or shift the nodes
+        uint64_t version_{0U};
+    };
+
+    // keeps the path from the root to the current leaf, the child taken at each inner node.
+    // The path is only followed while the tree has the version it was built at,
+    // otherwise the next step repeats the search from the root, so that it never follows a stale node
+    class Iterator : public ::Iterator {
+    public:
+        Iterator(std::shared_ptr<const Arena> arena, std::shared_ptr<Tree> tree)
+                : arena_(std::move(arena)), tree_(std::move(tree)) {}
+
+        [[nodiscard]] bool valid() const override { return current_ != nullptr; }
+
+        void seek(uint64_t target) override;
+
+        void next() override;
+
+        [[nodiscard]] uint64_t key() const override { return current_->key_; }
+
+        [[nodiscard]] std::string_view value() const override {
+            return current_->record_.load(std::memory_order_acquire)->value_;
+        }
+
+        [[nodiscard]] bool is_deleted() const override {
+            return current_->record_.load(std::memory_order_acquire)->deleted_;
+        }
+
+    private:
+        struct Frame {
+            const Inner *node_;
+            unsigned byte_;
+        };
+
+        // keeps the nodes alive
+        std::shared_ptr<const Arena> arena_;
+        std::shared_ptr<Tree> tree_;
+        const Leaf *current_{nullptr};
+        // every inner node takes at least one of the 8 key bytes
+        std::array<Frame, 8> path_{};
+        size_t depth_{0U};
+        uint64_t version_{0U};
+
+        // the following hold the lock of the tree
+
+        void search(uint64_t target);
+
+        // move to the smallest leaf of the subtree
+        void descend(Child child);
+
+        // move to the smallest leaf after the subtree of the deepest node on the path
+        void advance();
+    };
+
+public:
+    AdaptiveRadixTree();
+
+    ~AdaptiveRadixTree() override;
+
+    void reset() override;
+
+    [[nodiscard]] std::unique_ptr<::Iterator> iterator() const override;
+
+protected:
+    [[nodiscard]] Slot *find(uint64_t key) const override;
+
+    Slot *insert(uint64_t key, const Record *record, bool &inserted) override;
+
+private:
+    std::shared_ptr<Tree> tree;
+
+    [[nodiscard]] static uint8_t byte_at(uint64_t key, int depth) {
+        return static_cast<uint8_t>(key >> (56 - 8 * depth));
+    }
+
+    [[nodiscard]] static bool is_leaf(Child child) { return (child & 1U) != 0U; }
+
+    [[nodiscard]] static Leaf *as_leaf(Child child) { return reinterpret_cast<Leaf *>(child & ~Child(1U)); }
+
+    [[nodiscard]] static Inner *as_inner(Child child) { return reinterpret_cast<Inner *>(child); }
+
+    // the child of the key byte, nullptr if there is none
+    [[nodiscard]] static Child *find_child(Inner *node, uint8_t byte);
+
+    // the first child whose key byte >= byte, which is set to the key byte of the child, 0 if there is none
+    [[nodiscard]] static Child next_child(const Inner *node, unsigned &byte);
+
+    // add a child to the node at ref, which is replaced by a larger node when it is full
+    void add_child(Child *ref, uint8_t byte, Child child);
+
+    template<typename T>
+    T *new_node() { return new(arena->allocate(sizeof(T))) T(); }
+
+    // the arena aligns allocations, which leaves the lowest bit free for the leaf tag
+    Leaf *new_leaf(uint64_t key, const Record *record) {
+        return new(arena->allocate(sizeof(Leaf))) Leaf{key, {record}};
+    }
+};
@@ -29,6 +29,15 @@ protected:
         (void) std::cout.flush();
     }
 
+    void report_cache() const {
+        auto hits = static_cast<double>(store.get_cache_hits());
+        auto misses = static_cast<double>(store.get_cache_misses());
+        if (hits + misses > 0.0) {
+            std::cout << "block cache hit ratio " << hits * 100.0 / (hits + misses) << " %" << std::endl;
+        }
+        (void) std::cout.flush();
+    }
+
     class KVStore store;
 
     bool verbose;
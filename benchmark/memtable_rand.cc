@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <filesystem>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+
+namespace fs = std::filesystem;
+
+// random puts, gets and short scans against every kind of memtable, without the wal and the sstables
+class MemTableRand : public Bench {
+private:
+    const size_t nr_ops = 256U * 1024U;
+    const size_t bytes_per_op = 8U;
+    const size_t nr_bytes = nr_ops * bytes_per_op;
+    const uint64_t scan_width = 16U;
+
+    void regular_test(MemTableKind kind) {
+        std::unique_ptr<MemTable> memtable = MemTable::create(kind);
+        std::default_random_engine engine(0U);
+        std::uniform_int_distribution<uint64_t> uniform_dist(0U, UINT64_MAX);
+        std::vector<uint64_t> keys(nr_ops);
+        for (auto &key: keys) {
+            key = uniform_dist(engine);
+        }
+
+        std::cout << "put" << std::endl;
+        start();
+        for (uint64_t key: keys) {
+            memtable->put(key, std::string(bytes_per_op, 's'));
+        }
+        stop();
+        report(nr_ops, nr_bytes);
+
+        std::cout << "get" << std::endl;
+        std::shuffle(keys.begin(), keys.end(), engine);
+        bool deleted = false;
+        bool found = false;
+        start();
+        for (uint64_t key: keys) {
+            (void) memtable->get(key, deleted, found);
+        }
+        stop();
+        report(nr_ops, nr_bytes);
+
+        std::cout << "scan" << std::endl;
+        const size_t nr_scans = nr_ops / 16U;
+        std::vector<std::pair<uint64_t, std::string>> result;
+        start();
+        for (size_t i = 0U; i < nr_scans; ++i) {
+            result.clear();
+            // a range starting at a key holds a few keys at most, so the cost is mostly the seek
+            memtable->scan(keys[i], keys[i] + scan_width, result);
+        }
+        stop();
+        report(nr_scans, nr_scans * bytes_per_op);
+
+        std::cout << "memory " << memtable->get_memory_usage() / 1024U << " KB" << std::endl;
+    }
+
+public:
+    explicit MemTableRand(const std::string &dir, bool v = true)
+            : Bench(dir, v) {
+    }
+
+    void start_test(void *args = nullptr) override {
+        std::cout << "MemTable Random Bench" << std::endl;
+        std::cout << "[skiplist]" << std::endl;
+        regular_test(MemTableKind::SKIPLIST);
+        std::cout << "[hash linked list]" << std::endl;
+        regular_test(MemTableKind::HASH_LINKLIST);
+        std::cout << "[adaptive radix tree]" << std::endl;
+        regular_test(MemTableKind::ART);
+    }
+};
+
+int main(int argc, char *argv[]) {
+    bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+    std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+    std::cout << "  -v: print extra info for failed tests [currently ";
+    std::cout << (verbose ? "ON" : "OFF") << "]" << std::endl;
+    std::cout << std::endl;
+    (void) std::cout.flush();
+
+    (void) fs::remove_all("data");
+
+    MemTableRand test("data", verbose);
+
+    test.start_test();
+
+    return 0;
+}
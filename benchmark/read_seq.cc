@@ -24,6 +24,7 @@ private:
         }
         stop();
         report(nr_ops, nr_bytes);
+        report_cache();
     }
 
 public:
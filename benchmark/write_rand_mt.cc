@@ -0,0 +1,70 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+
+namespace fs = std::filesystem;
+
+class WriteRandMT : public Bench {
+private:
+    const size_t nr_ops = 1024U * 1024U;
+    const size_t bytes_per_op = 1U;
+    const size_t nr_bytes = nr_ops * bytes_per_op;
+
+    // nr_ops puts in total, spread over the threads
+    void regular_test(size_t nr_threads) {
+        std::vector<std::thread> threads;
+        start();
+        for (size_t t = 0U; t < nr_threads; ++t) {
+            (void) threads.emplace_back([this, nr_threads]() {
+                std::random_device device;
+                std::default_random_engine engine(device());
+                std::uniform_int_distribution<uint64_t> uniform_dist(0U, nr_ops - 1U);
+                for (size_t i = 0U; i < nr_ops / nr_threads; ++i) {
+                    store.put(uniform_dist(engine), std::string(bytes_per_op, 's'));
+                }
+            });
+        }
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        stop();
+        report(nr_ops, nr_bytes);
+    }
+
+public:
+    explicit WriteRandMT(const std::string &dir, bool v = true)
+            : Bench(dir, v) {
+    }
+
+    void start_test(void *args = nullptr) override {
+        std::cout << "KVStore Multi-threaded Random Write Bench" << std::endl;
+        for (size_t nr_threads: {1U, 2U, 4U, 8U}) {
+            std::cout << "[" << nr_threads << " threads]" << std::endl;
+            regular_test(nr_threads);
+        }
+    }
+};
+
+int main(int argc, char *argv[]) {
+    bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+    std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+    std::cout << "  -v: print extra info for failed tests [currently ";
+    std::cout << (verbose ? "ON" : "OFF") << "]" << std::endl;
+    std::cout << std::endl;
+    (void) std::cout.flush();
+
+    (void) fs::remove_all("data");
+
+    WriteRandMT test("data", verbose);
+
+    test.start_test();
+
+    return 0;
+}
@@ -1,31 +1,93 @@
 #include "bloom.h"
-#include "util/MurmurHash3.h"
+#include "coding.h"
 
-BloomFilter::BloomFilter() {
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// odd multipliers picking one bit per word of a line, from https://github.com/apache/impala
+alignas(32) const uint32_t SALTS[8] = {
+        0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+        0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+void blocked_masks(uint32_t h, uint64_t masks[8]) {
+    for (int i = 0; i < 8; i++) {
+        masks[i] = 1ULL << ((h * SALTS[i]) >> 26);
+    }
+}
+
+}
+
+BloomFilter::BloomFilter(uint64_t nr_keys, uint32_t bits_per_key, BloomKind kind) : kind(kind) {
+    // tiny filters have a high false positive rate, use at least one line
+    m = std::max<uint64_t>(nr_keys * bits_per_key, LINE_BITS);
+    m = (m + LINE_BITS - 1U) / LINE_BITS * LINE_BITS;
+    if (kind == BloomKind::BLOCKED) {
+        // one bit in each word of a line
+        k = 8U;
+    } else {
+        // k == m / n * ln(2), rounded down to save probes
+        k = static_cast<uint32_t>(bits_per_key * 0.69);
+        k = std::clamp<uint32_t>(k, 1U, 30U);
+    }
     reset();
 }
 
+BloomFilter::BloomFilter(std::string_view encoded) {
+    const uint64_t header = HEADER_SIZE;
+    if (encoded.size() < header) {
+        return;
+    }
+    uint64_t bits = get_fixed64(encoded.data());
+    uint32_t hashes = get_fixed32(encoded.data() + sizeof(uint64_t));
+    auto type = static_cast<uint8_t>(encoded[header - 1U]);
+    if (bits == 0U || bits % LINE_BITS != 0U || encoded.size() - header != bits / 8U || hashes == 0U ||
+        type > static_cast<uint8_t>(BloomKind::BLOCKED)) {
+        return;
+    }
+    m = bits;
+    k = hashes;
+    kind = static_cast<BloomKind>(type);
+    reset();
+    (void) std::memcpy(static_cast<void *>(lines.data()), encoded.data() + header, bits / 8U);
+}
+
 BloomFilter::~BloomFilter() = default;
 
-void BloomFilter::add(uint64_t key) {
-    uint32_t h;
-    MurmurHash3_x86_32(&key, sizeof(uint64_t), 0U, &h);
+void BloomFilter::add_hash(uint64_t h) {
+    if (m == 0U) {
+        return;
+    }
+    if (kind == BloomKind::BLOCKED) {
+        add_blocked(h);
+        return;
+    }
     // inspired by https://github.com/google/leveldb/blob/main/util/bloom.cc
-    const uint32_t delta = (h >> 17) | (h << 15);
-    for (uint64_t i = 0U; i < k; i++) {
-        const uint32_t bitpos = h % m;
-        (void) bitset.set(bitpos);
+    const uint64_t delta = (h >> 33) | (h << 31);
+    for (uint32_t i = 0U; i < k; i++) {
+        set_bit(h % m);
         h += delta;
     }
 }
 
-bool BloomFilter::contains(uint64_t key) const {
-    uint32_t h;
-    MurmurHash3_x86_32(&key, sizeof(uint64_t), 0U, &h);
-    const uint32_t delta = (h >> 17) | (h << 15);
-    for (uint64_t i = 0U; i < k; i++) {
-        const uint32_t bitpos = h % m;
-        if (bitset[bitpos] == 0) {
+bool BloomFilter::contains_hash(uint64_t h) const {
+    if (m == 0U) {
+        return true;
+    }
+    if (kind == BloomKind::BLOCKED) {
+        return contains_blocked(h);
+    }
+    const uint64_t delta = (h >> 33) | (h << 31);
+    for (uint32_t i = 0U; i < k; i++) {
+        if (!get_bit(h % m)) {
             return false;
         }
         h += delta;
@@ -33,6 +95,97 @@ bool BloomFilter::contains(uint64_t key) const {
     return true;
 }
 
+// the upper half of the hash selects the line, the lower half the bits inside it
+void BloomFilter::add_blocked(uint64_t h) {
+    Line &line = lines[((h >> 32) * lines.size()) >> 32];
+    uint64_t masks[8];
+    blocked_masks(static_cast<uint32_t>(h), masks);
+    for (int i = 0; i < 8; i++) {
+        line.words[i] |= masks[i];
+    }
+}
+
+bool BloomFilter::contains_blocked(uint64_t h) const {
+    const Line &line = lines[((h >> 32) * lines.size()) >> 32];
+#if defined(__AVX2__)
+    // shift a one by each of the 8 bit positions and test both halves of the line against the masks
+    const __m256i pos = _mm256_srli_epi32(
+            _mm256_mullo_epi32(_mm256_set1_epi32(static_cast<int>(h)),
+                               _mm256_load_si256(reinterpret_cast<const __m256i *>(SALTS))), 26);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(pos)));
+    const __m256i hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(pos, 1)));
+    return _mm256_testc_si256(_mm256_load_si256(reinterpret_cast<const __m256i *>(&line.words[0])), lo) != 0 &&
+           _mm256_testc_si256(_mm256_load_si256(reinterpret_cast<const __m256i *>(&line.words[4])), hi) != 0;
+#elif defined(__SSE2__)
+    alignas(16) uint64_t masks[8];
+    blocked_masks(static_cast<uint32_t>(h), masks);
+    // collect the mask bits missing from the line, the key may be present iff none is missing
+    __m128i missing = _mm_setzero_si128();
+    for (int i = 0; i < 8; i += 2) {
+        missing = _mm_or_si128(missing, _mm_andnot_si128(
+                _mm_load_si128(reinterpret_cast<const __m128i *>(&line.words[i])),
+                _mm_load_si128(reinterpret_cast<const __m128i *>(&masks[i]))));
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#else
+    uint64_t masks[8];
+    blocked_masks(static_cast<uint32_t>(h), masks);
+    for (int i = 0; i < 8; i++) {
+        if ((line.words[i] & masks[i]) != masks[i]) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
 void BloomFilter::reset() {
-    (void) bitset.reset();
+    lines.assign(m / LINE_BITS, Line{});
+}
+
+void BloomFilter::encode(std::string &dst) const {
+    put_fixed64(dst, m);
+    put_fixed32(dst, k);
+    (void) dst.append(1U, static_cast<char>(kind));
+    (void) dst.append(reinterpret_cast<const char *>(lines.data()), lines.size() * sizeof(Line));
+}
+
+uint64_t BloomFilter::encoded_length(std::string_view src) {
+    if (src.size() < HEADER_SIZE) {
+        return 0U;
+    }
+    uint64_t length = HEADER_SIZE + get_fixed64(src.data()) / 8U;
+    return length <= src.size() ? length : 0U;
+}
+
+RangeFilter::RangeFilter(uint32_t shift, uint64_t nr_prefixes, uint32_t bits_per_key)
+        : shift(std::min(shift, 63U)), filter(nr_prefixes, bits_per_key) {}
+
+RangeFilter::RangeFilter(std::string_view encoded)
+        : shift(encoded.empty() ? 0U : std::min<uint32_t>(static_cast<uint8_t>(encoded[0]), 63U)),
+          filter(encoded.empty() ? std::string_view() : encoded.substr(1U)) {}
+
+bool RangeFilter::may_contain(uint64_t lower, uint64_t upper) const {
+    if (lower > upper) {
+        return false;
+    }
+    const uint64_t first = lower >> shift;
+    const uint64_t last = upper >> shift;
+    if (last - first >= MAX_PROBES) {
+        return true;
+    }
+    for (uint64_t prefix = first;; ++prefix) {
+        if (filter.contains(prefix)) {
+            return true;
+        }
+        if (prefix == last) {
+            return false;
+        }
+    }
+}
+
+void RangeFilter::encode(std::string &dst) const {
+    (void) dst.append(1U, static_cast<char>(shift));
+    filter.encode(dst);
 }
@@ -0,0 +1,135 @@
+/**
+ * A sharded LRU cache. Each shard has its own lock, list and hash map, and a key always goes to the same shard.
+ * Values are held by shared_ptr, so an entry evicted while in use stays alive until its last user releases it.
+ * Pinned entries count towards the capacity but are never evicted, only erased.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+template<typename K, typename V, typename Hash = std::hash<K>>
+class LRUCache {
+public:
+    explicit LRUCache(size_t capacity, size_t shards = 16U)
+            : shards_(std::make_unique<Shard[]>(shards)), nr_shards_(shards) {
+        for (size_t i = 0U; i < nr_shards_; ++i) {
+            shards_[i].capacity_ = (capacity + nr_shards_ - 1U) / nr_shards_;
+        }
+    }
+
+    // nullptr if the key is not cached
+    std::shared_ptr<V> get(const K &key) {
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        auto iter = shard.map_.find(key);
+        if (iter == shard.map_.end()) {
+            (void) misses_.fetch_add(1U, std::memory_order_relaxed);
+            return nullptr;
+        }
+        (void) hits_.fetch_add(1U, std::memory_order_relaxed);
+        // move to the front as the most recently used
+        if (!iter->second->pinned_) {
+            shard.lru_.splice(shard.lru_.begin(), shard.lru_, iter->second);
+        }
+        return iter->second->value_;
+    }
+
+    // insert or replace an entry which costs `charge` units of the capacity
+    void put(const K &key, std::shared_ptr<V> value, size_t charge = 1U, bool pinned = false) {
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        auto iter = shard.map_.find(key);
+        if (iter != shard.map_.end()) {
+            remove(shard, iter);
+        }
+        std::list<Entry> &list = pinned ? shard.pinned_ : shard.lru_;
+        list.push_front({key, std::move(value), charge, pinned});
+        shard.map_[key] = list.begin();
+        shard.usage_ += charge;
+        // evict from the least recently used, but always keep the new entry
+        while (shard.usage_ > shard.capacity_ && !shard.lru_.empty() && &shard.lru_.back() != &list.front()) {
+            Entry &victim = shard.lru_.back();
+            shard.usage_ -= victim.charge_;
+            (void) shard.map_.erase(victim.key_);
+            shard.lru_.pop_back();
+        }
+    }
+
+    void erase(const K &key) {
+        Shard &shard = shard_of(key);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        auto iter = shard.map_.find(key);
+        if (iter == shard.map_.end()) {
+            return;
+        }
+        remove(shard, iter);
+    }
+
+    void clear() {
+        for (size_t i = 0U; i < nr_shards_; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+            shards_[i].lru_.clear();
+            shards_[i].pinned_.clear();
+            shards_[i].map_.clear();
+            shards_[i].usage_ = 0U;
+        }
+    }
+
+    [[nodiscard]] uint64_t get_hits() const { return hits_.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] uint64_t get_misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    // total charge of the cached entries
+    [[nodiscard]] size_t get_usage() const {
+        size_t usage = 0U;
+        for (size_t i = 0U; i < nr_shards_; ++i) {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex_);
+            usage += shards_[i].usage_;
+        }
+        return usage;
+    }
+
+private:
+    struct Entry {
+        K key_;
+        std::shared_ptr<V> value_;
+        size_t charge_;
+        bool pinned_;
+    };
+
+    typedef std::unordered_map<K, typename std::list<Entry>::iterator, Hash> Map;
+
+    struct Shard {
+        mutable std::mutex mutex_;
+        std::list<Entry> lru_;
+        std::list<Entry> pinned_;
+        Map map_;
+        size_t usage_{0U};
+        size_t capacity_{0U};
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t nr_shards_;
+    std::atomic<uint64_t> hits_{0U};
+    std::atomic<uint64_t> misses_{0U};
+
+    static void remove(Shard &shard, typename Map::iterator iter) {
+        shard.usage_ -= iter->second->charge_;
+        (iter->second->pinned_ ? shard.pinned_ : shard.lru_).erase(iter->second);
+        (void) shard.map_.erase(iter);
+    }
+
+    Shard &shard_of(const K &key) {
+        // mix the hash so that shards do not depend on the low bits only
+        uint64_t h = static_cast<uint64_t>(Hash()(key)) * 0x9e3779b97f4a7c15ULL;
+        return shards_[(h >> 32U) % nr_shards_];
+    }
+};
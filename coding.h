@@ -0,0 +1,29 @@
+/**
+ * Fixed-width encoding of integers in the byte order of the host
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+inline void put_fixed32(std::string &dst, uint32_t value) {
+    (void) dst.append(reinterpret_cast<const char *>(&value), sizeof(uint32_t));
+}
+
+inline uint32_t get_fixed32(const char *src) {
+    uint32_t value;
+    (void) std::memcpy(&value, src, sizeof(uint32_t));
+    return value;
+}
+
+inline void put_fixed64(std::string &dst, uint64_t value) {
+    (void) dst.append(reinterpret_cast<const char *>(&value), sizeof(uint64_t));
+}
+
+inline uint64_t get_fixed64(const char *src) {
+    uint64_t value;
+    (void) std::memcpy(&value, src, sizeof(uint64_t));
+    return value;
+}
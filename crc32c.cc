@@ -0,0 +1,69 @@
+#include "crc32c.h"
+#include "coding.h"
+
+#include <array>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace {
+
+#if !defined(__SSE4_2__)
+
+// the reflected Castagnoli polynomial
+const uint32_t POLY = 0x82f63b78U;
+
+typedef std::array<std::array<uint32_t, 256>, 8> Tables;
+
+// slicing-by-8, TABLES[k][b] is the crc of the byte b followed by k zero bytes
+Tables make_tables() {
+    Tables tables{};
+    for (uint32_t b = 0U; b < 256U; ++b) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1U) ^ ((crc & 1U) != 0U ? POLY : 0U);
+        }
+        tables[0][b] = crc;
+    }
+    for (uint32_t b = 0U; b < 256U; ++b) {
+        for (size_t k = 1U; k < 8U; ++k) {
+            tables[k][b] = (tables[k - 1U][b] >> 8U) ^ tables[0][tables[k - 1U][b] & 0xffU];
+        }
+    }
+    return tables;
+}
+
+const Tables TABLES = make_tables();
+
+#endif
+
+}
+
+uint32_t crc32c(const char *data, size_t n, uint32_t crc) {
+    auto p = reinterpret_cast<const uint8_t *>(data);
+    crc = ~crc;
+#if defined(__SSE4_2__)
+    uint64_t crc64 = crc;
+    for (; n >= 8U; n -= 8U, p += 8U) {
+        crc64 = _mm_crc32_u64(crc64, get_fixed64(reinterpret_cast<const char *>(p)));
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; n > 0U; --n, ++p) {
+        crc = _mm_crc32_u8(crc, *p);
+    }
+#else
+    for (; n >= 8U; n -= 8U, p += 8U) {
+        // the table lookups assume little-endian words, as does the rest of the encoding
+        const uint64_t word = get_fixed64(reinterpret_cast<const char *>(p)) ^ crc;
+        crc = TABLES[7][word & 0xffU] ^ TABLES[6][(word >> 8U) & 0xffU] ^
+              TABLES[5][(word >> 16U) & 0xffU] ^ TABLES[4][(word >> 24U) & 0xffU] ^
+              TABLES[3][(word >> 32U) & 0xffU] ^ TABLES[2][(word >> 40U) & 0xffU] ^
+              TABLES[1][(word >> 48U) & 0xffU] ^ TABLES[0][word >> 56U];
+    }
+    for (; n > 0U; --n, ++p) {
+        crc = (crc >> 8U) ^ TABLES[0][(crc ^ *p) & 0xffU];
+    }
+#endif
+    return ~crc;
+}
@@ -0,0 +1,11 @@
+/**
+ * CRC32C (Castagnoli), the checksum of the wal records
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// extend the crc of the preceding bytes with n more, crc32c(data, n) of a whole buffer
+uint32_t crc32c(const char *data, size_t n, uint32_t crc = 0U);
@@ -1,42 +1,226 @@
 #include "disk.h"
 #include "index.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <filesystem>
-#include <fstream>
 #include <string>
-#include <iostream>
-#include <chrono>
 
 namespace fs = std::filesystem;
 
-std::string Disk::get(int level, uint64_t filename, uint64_t offset, uint64_t length) const {
+TableFile::TableFile(const std::string &path, bool mmap) : fd_(::open(path.c_str(), O_RDONLY | O_CLOEXEC)) {
+    struct stat st{};
+    if (!mmap || fd_ < 0 || ::fstat(fd_, &st) != 0 || st.st_size == 0) {
+        return;
+    }
+    void *mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        // fall back to pread
+        return;
+    }
+    mapping_ = mapping;
+    size_ = static_cast<uint64_t>(st.st_size);
+    // most reads are point lookups of a single block
+    (void) ::madvise(mapping_, size_, MADV_RANDOM);
+}
+
+TableFile::~TableFile() {
+    if (mapping_ != nullptr) {
+        (void) ::munmap(mapping_, size_);
+    }
+    if (fd_ >= 0) {
+        (void) ::close(fd_);
+    }
+}
+
+bool TableFile::view(uint64_t offset, uint64_t length, std::string_view &dst) const {
+    if (mapping_ == nullptr || offset + length > size_) {
+        return false;
+    }
+    dst = std::string_view(static_cast<const char *>(mapping_) + offset, length);
+    return true;
+}
+
+void TableFile::advise(uint64_t offset, uint64_t length, bool sequential) const {
+    if (mapping_ == nullptr || offset >= size_) {
+        return;
+    }
+    // the advice starts at a page boundary, the point lookups of the rest of the mapping are not affected
+    const auto page = static_cast<uint64_t>(::sysconf(_SC_PAGESIZE));
+    const uint64_t begin = offset / page * page;
+    const uint64_t end = std::min(offset + length, size_);
+    (void) ::madvise(static_cast<char *>(mapping_) + begin, end - begin, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+}
+
+bool TableFile::read(uint64_t offset, uint64_t length, std::string &dst) const {
+    dst.resize(length);
+    uint64_t done = 0U;
+    while (done < length) {
+        ssize_t n = ::pread(fd_, dst.data() + done, length - done, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        done += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+std::shared_ptr<TableFile> Disk::open(int level, uint64_t filename) const {
+    std::shared_ptr<TableFile> file = tables_.get({level, filename});
+    if (file != nullptr) {
+        return file;
+    }
+    file = std::make_shared<TableFile>(path(level, filename), options_.use_mmap);
+    if (!file->is_open()) {
+        return nullptr;
+    }
+    tables_.put({level, filename}, file);
+    return file;
+}
+
+std::shared_ptr<Block> Disk::get(int level, uint64_t filename, const IndexNode &node, bool fill_cache) const {
+    bool cached = options_.block_cache_capacity > 0U;
+    BlockKey key{level, filename, node.get_offset()};
+    if (cached) {
+        std::shared_ptr<Block> block = blocks_.get(key);
+        if (block != nullptr) {
+            return block;
+        }
+    }
+    std::shared_ptr<TableFile> file = open(level, filename);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    std::shared_ptr<Block> block;
+    std::string_view view;
+    std::string data;
+    if (file->view(node.get_offset(), node.get_length(), view)) {
+        // the block refers to the mapping, which stays mapped while the block is alive
+        block = std::make_shared<Block>(view, file);
+    } else if (file->read(node.get_offset(), node.get_length(), data)) {
+        block = std::make_shared<Block>(std::move(data));
+    } else {
+        return nullptr;
+    }
+    if (cached && fill_cache) {
+        blocks_.put(key, block, block->get_memory_usage(), options_.pin_l0_blocks && level == 0);
+    }
+    return block;
+}
+
+std::unique_ptr<Iterator> Disk::iterator(int level, uint64_t filename, std::shared_ptr<IndexTable> table,
+                                         bool fill_cache) const {
+    std::shared_ptr<TableFile> file;
+    if (!fill_cache) {
+        file = open(level, filename);
+    }
+    return std::make_unique<TableIterator>(*this, level, filename, std::move(table), fill_cache, std::move(file));
+}
+
+std::string Disk::path(int level, uint64_t filename) const {
     fs::path path = dir_;
     path /= std::to_string(level);
     path /= std::to_string(filename);
-    std::ifstream file(path, std::ios::in | std::ios::binary);
-    std::string value;
-    (void) file.seekg(offset + sizeof(uint64_t));
-    (void) std::getline(file, value, '\0');
-    file.close();
-    return value;
+    return path.string();
 }
 
-void Disk::get(const Batch &batch, std::map<uint64_t, const std::string> &kv) const {
-    fs::path path = dir_;
-    path /= std::to_string(batch.level_);
-    path /= std::to_string(batch.filename_);
-    std::ifstream file(path, std::ios::in | std::ios::binary);
-    for (auto &it: batch.infos_) {
-        auto [key, offset, length] = it;
-        std::string value;
-        (void) file.seekg(offset + sizeof(uint64_t));
-        (void) std::getline(file, value, '\0');
-        (void) kv.insert({key, value});
+void Disk::remove(int level, uint64_t filename, const IndexTable &table) {
+    for (size_t i = 0U; i < table.get_nr_blocks(); ++i) {
+        blocks_.erase({level, filename, table.get_node(i).get_offset()});
     }
-    file.close();
+    tables_.erase({level, filename});
+    (void) fs::remove(path(level, filename));
 }
 
-Disk::Disk(const std::string &dir) : dir_(dir) {}
+Disk::Disk(const std::string &dir, const Options &options)
+        : dir_(dir), tables_(MAX_OPEN_FILES), options_(options), blocks_(options.block_cache_capacity) {}
 
 void Disk::reset() {
+    tables_.clear();
+    blocks_.clear();
+}
+
+TableIterator::TableIterator(const Disk &disk, int level, uint64_t filename, std::shared_ptr<IndexTable> table,
+                             bool fill_cache, std::shared_ptr<const TableFile> file)
+        : disk_(disk), level_(level), filename_(filename), table_(std::move(table)), fill_cache_(fill_cache),
+          node_(table_->get_nr_blocks()), file_(std::move(file)) {
+    advise(true);
+}
+
+TableIterator::~TableIterator() {
+    // the mapping is shared with the point lookups of the table
+    advise(false);
+}
+
+void TableIterator::advise(bool sequential) const {
+    const size_t nr_blocks = table_->get_nr_blocks();
+    if (file_ == nullptr || nr_blocks == 0U) {
+        return;
+    }
+    // the data blocks are written first, in key order
+    const IndexNode first = table_->get_node(0U);
+    const IndexNode last = table_->get_node(nr_blocks - 1U);
+    file_->advise(first.get_offset(), last.get_offset() + last.get_length() - first.get_offset(), sequential);
+}
+
+bool TableIterator::valid() const {
+    return node_ < table_->get_nr_blocks();
+}
 
+void TableIterator::seek(uint64_t target) {
+    entry_ = 0U;
+    block_ = nullptr;
+    if (!table_->find(target, node_)) {
+        // either every key is greater than the target or every key is less than it
+        node_ = target < table_->get_min_key() ? 0U : table_->get_nr_blocks();
+        load();
+        return;
+    }
+    block_ = disk_.get(level_, filename_, table_->get_node(node_), fill_cache_);
+    if (block_ != nullptr) {
+        entry_ = block_->lower_bound(target);
+    }
+    load();
+}
+
+void TableIterator::next() {
+    ++entry_;
+    load();
+}
+
+uint64_t TableIterator::key() const {
+    return block_->key(entry_);
+}
+
+std::string_view TableIterator::value() const {
+    return block_->value(entry_);
+}
+
+bool TableIterator::is_deleted() const {
+    return block_->is_deleted(entry_);
+}
+
+void TableIterator::load() {
+    while (node_ < table_->get_nr_blocks()) {
+        if (block_ == nullptr) {
+            block_ = disk_.get(level_, filename_, table_->get_node(node_), fill_cache_);
+            entry_ = 0U;
+            if (block_ == nullptr) {
+                // unreadable table, stop here
+                node_ = table_->get_nr_blocks();
+                return;
+            }
+        }
+        if (entry_ < block_->size()) {
+            return;
+        }
+        ++node_;
+        block_ = nullptr;
+    }
 }
@@ -1,34 +1,97 @@
 #pragma once
 
 #include "index.h"
-#include "data.h"
 #include "skiplist.h"
 #include "filter.h"
-#include "batch.h"
+#include "iterator.h"
+#include "table.h"
+#include "cache.h"
+#include "options.h"
 
-#include <queue>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
-using Range = std::vector<std::pair<uint64_t, uint64_t>>;
-
 /**
- * information for compaction
+ * An open sstable, read with positional reads so that one descriptor can serve concurrent readers.
+ * Optionally the whole file is mapped into memory, the mapping lives as long as the TableFile.
  */
-class MergeNode {
+class TableFile {
 public:
-    MergeNode(int level, uint64_t filename, IndexTree::iterator iter)
-            : level_(level), filename_(filename), iter_(iter) {}
+    TableFile(const std::string &path, bool mmap);
+
+    TableFile(const TableFile &) = delete;
+
+    TableFile &operator=(const TableFile &) = delete;
+
+    ~TableFile();
+
+    [[nodiscard]] bool is_open() const { return fd_ >= 0; }
+
+    // read exactly `length` bytes at `offset`
+    bool read(uint64_t offset, uint64_t length, std::string &dst) const;
+
+    [[nodiscard]] bool is_mapped() const { return mapping_ != nullptr; }
+
+    // `length` bytes at `offset` of the mapping, false if out of range
+    bool view(uint64_t offset, uint64_t length, std::string_view &dst) const;
+
+    // the mapped bytes [offset, offset + length) are about to be read once in order if sequential is set,
+    // or are back to the random reads of point lookups otherwise
+    void advise(uint64_t offset, uint64_t length, bool sequential) const;
 
 private:
-    friend class Disk;
+    int fd_;
+    void *mapping_{nullptr};
+    uint64_t size_{0U};
+};
+
+class Disk;
+
+/**
+ * Iterates an sstable in key order, one data block at a time.
+ */
+class TableIterator : public Iterator {
+public:
+    // a file is advised for sequential reads of the data blocks while they are iterated
+    TableIterator(const Disk &disk, int level, uint64_t filename, std::shared_ptr<IndexTable> table, bool fill_cache,
+                  std::shared_ptr<const TableFile> file = nullptr);
+
+    TableIterator(const TableIterator &) = delete;
+
+    TableIterator &operator=(const TableIterator &) = delete;
+
+    ~TableIterator() override;
+
+    [[nodiscard]] bool valid() const override;
+
+    void seek(uint64_t target) override;
 
-    friend class KVStore;
+    void next() override;
 
+    [[nodiscard]] uint64_t key() const override;
+
+    [[nodiscard]] std::string_view value() const override;
+
+    [[nodiscard]] bool is_deleted() const override;
+
+private:
+    const Disk &disk_;
     int level_;
     uint64_t filename_;
-    IndexTree::iterator iter_;
+    std::shared_ptr<IndexTable> table_;
+    bool fill_cache_;
+    size_t node_;                  // current data block
+    std::shared_ptr<Block> block_;
+    size_t entry_{0U};             // current record in the data block
+    std::shared_ptr<const TableFile> file_;
+
+    // advise the data blocks of file_, if any
+    void advise(bool sequential) const;
+
+    // load data blocks from node_ on until one of them has a record at or after entry_
+    void load();
 };
 
 class Disk {
@@ -37,12 +100,65 @@ private:
 
     static const int maxLevel = 20;
 
+    static const size_t MAX_OPEN_FILES = 1024U;
+
+    struct TableKeyHash {
+        size_t operator()(const std::pair<int, uint64_t> &key) const {
+            return std::hash<uint64_t>()(key.second * 31U + static_cast<uint64_t>(key.first));
+        }
+    };
+
+    // open sstables, keyed by (level, filename)
+    mutable LRUCache<std::pair<int, uint64_t>, TableFile, TableKeyHash> tables_;
+
+    struct BlockKey {
+        int level_;
+        uint64_t filename_;
+        uint64_t offset_;
+
+        bool operator==(const BlockKey &other) const {
+            return level_ == other.level_ && filename_ == other.filename_ && offset_ == other.offset_;
+        }
+    };
+
+    struct BlockKeyHash {
+        size_t operator()(const BlockKey &key) const {
+            return std::hash<uint64_t>()((key.filename_ * 31U + static_cast<uint64_t>(key.level_)) * 31U + key.offset_);
+        }
+    };
+
+    Options options_;
+
+    // decoded data blocks, charged by their memory usage
+    mutable LRUCache<BlockKey, Block, BlockKeyHash> blocks_;
+
+    [[nodiscard]] std::shared_ptr<TableFile> open(int level, uint64_t filename) const;
+
 public:
-    Disk(const std::string &dir);
+    Disk(const std::string &dir, const Options &options);
+
+    /**
+     * Read and decode a data block of an sstable, nullptr if it cannot be read.
+     * The block cache is looked up first, a block read from the file is cached iff fill_cache is set.
+     */
+    [[nodiscard]] std::shared_ptr<Block> get(int level, uint64_t filename, const IndexNode &node,
+                                             bool fill_cache = true) const;
+
+    /**
+     * Iterate an sstable. fill_cache is false for a one-off pass such as compaction: blocks are not cached,
+     * and the data blocks of a mapped sstable are advised for sequential access until the iterator is destroyed.
+     */
+    [[nodiscard]] std::unique_ptr<Iterator> iterator(int level, uint64_t filename, std::shared_ptr<IndexTable> table,
+                                                     bool fill_cache = true) const;
+
+    [[nodiscard]] std::string path(int level, uint64_t filename) const;
+
+    // close, unmap and delete an sstable, its data blocks are dropped from the block cache
+    void remove(int level, uint64_t filename, const IndexTable &table);
 
-    [[nodiscard]] std::string get(int level, uint64_t filename, uint64_t offset, uint64_t length) const;
+    [[nodiscard]] uint64_t get_cache_hits() const { return blocks_.get_hits(); }
 
-    void get(const Batch &batch, std::map<uint64_t, const std::string> &kv) const;
+    [[nodiscard]] uint64_t get_cache_misses() const { return blocks_.get_misses(); }
 
     void reset();
 };
@@ -1,6 +1,6 @@
 
 #include "filter.h"
-#include <iostream>
+#include <fstream>
 
 Filter::Filter() {
     filterLevels = std::vector<FilterLevel>(maxLevel);
@@ -8,26 +8,66 @@ Filter::Filter() {
 
 Filter::~Filter() = default;
 
-void Filter::add(uint64_t key, int level, uint64_t filename) {
-    if (filterLevels[level].count(filename) == 0U) {
-        (void) filterLevels[level].insert({filename, BloomFilter()});
-    }
-    BloomFilter &bloomFilter = filterLevels[level][filename];
-    bloomFilter.add(key);
+void Filter::put(int level, uint64_t filename, std::shared_ptr<BloomFilter> bloomFilter,
+                 std::shared_ptr<RangeFilter> rangeFilter) {
+    auto handle = std::make_shared<Handle>();
+    handle->bloomFilter_ = std::move(bloomFilter);
+    handle->rangeFilter_ = std::move(rangeFilter);
+    filterLevels[level][filename] = handle;
+}
+
+void Filter::erase(int level, uint64_t filename) {
+    (void) filterLevels[level].erase(filename);
 }
 
-bool Filter::contains(uint64_t key, int level, uint64_t filename) const {
-    if (filterLevels[level].count(filename) == 0U) {
+bool Filter::contains(uint64_t h, int level, uint64_t filename) const {
+    auto iter = filterLevels[level].find(filename);
+    if (iter == filterLevels[level].end()) {
         return false;
     }
-    const BloomFilter &bloomFilter = filterLevels[level].at(filename);
-    return bloomFilter.contains(key);
+    Handle &handle = *iter->second;
+    std::call_once(handle.loaded_, &Handle::load, &handle);
+    // if the filter block cannot be read, the key may be in the table
+    return handle.bloomFilter_ == nullptr || handle.bloomFilter_->contains_hash(h);
+}
+
+bool Filter::may_contain(uint64_t lower, uint64_t upper, int level, uint64_t filename) const {
+    auto iter = filterLevels[level].find(filename);
+    if (iter == filterLevels[level].end()) {
+        return true;
+    }
+    Handle &handle = *iter->second;
+    std::call_once(handle.loaded_, &Handle::load, &handle);
+    return handle.rangeFilter_ == nullptr || handle.rangeFilter_->may_contain(lower, upper);
 }
 
 void Filter::reset() {
     filterLevels = std::vector<FilterLevel>(maxLevel);
 }
 
-void Filter::recover() {
+void Filter::recover(int level, uint64_t filename, const std::string &path, uint64_t offset, uint64_t length) {
+    auto handle = std::make_shared<Handle>();
+    handle->path_ = path;
+    handle->offset_ = offset;
+    handle->length_ = length;
+    filterLevels[level][filename] = handle;
+}
 
+void Filter::Handle::load() {
+    if (bloomFilter_ != nullptr) {
+        return;
+    }
+    std::ifstream file(path_, std::ios::in | std::ios::binary);
+    std::string bits(length_, '\0');
+    (void) file.seekg(static_cast<std::streamoff>(offset_));
+    (void) file.read(bits.data(), static_cast<std::streamsize>(bits.size()));
+    if (!file) {
+        return;
+    }
+    // the bloom filter may be followed by a range filter
+    uint64_t length = BloomFilter::encoded_length(bits);
+    bloomFilter_ = std::make_shared<BloomFilter>(std::string_view(bits).substr(0U, length));
+    if (length > 0U && length < bits.size()) {
+        rangeFilter_ = std::make_shared<RangeFilter>(std::string_view(bits).substr(length));
+    }
 }
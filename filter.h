@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
 
 #include "bloom.h"
 
@@ -13,18 +15,38 @@ public:
 
     ~Filter();
 
-    void add(uint64_t key, int level, uint64_t filename);
+    void put(int level, uint64_t filename, std::shared_ptr<BloomFilter> bloomFilter,
+             std::shared_ptr<RangeFilter> rangeFilter = nullptr);
 
-    [[nodiscard]] bool contains(uint64_t key, int level, uint64_t filename) const;
+    void erase(int level, uint64_t filename);
+
+    // h is BloomFilter::hash() of the key, computed once for all the tables probed
+    [[nodiscard]] bool contains(uint64_t h, int level, uint64_t filename) const;
+
+    // whether the table may hold a key in [lower, upper], true if it has no range filter
+    [[nodiscard]] bool may_contain(uint64_t lower, uint64_t upper, int level, uint64_t filename) const;
 
     void reset();
 
-    void recover();
+    // register the filter block of a recovered sstable, it is read in one call on the first probe
+    void recover(int level, uint64_t filename, const std::string &path, uint64_t offset, uint64_t length);
 
 private:
     const int maxLevel = 20;
 
-    typedef std::map<uint64_t, BloomFilter> FilterLevel;
+    class Handle {
+    public:
+        std::string path_;
+        uint64_t offset_{0U};
+        uint64_t length_{0U};
+        std::once_flag loaded_;
+        std::shared_ptr<BloomFilter> bloomFilter_;
+        std::shared_ptr<RangeFilter> rangeFilter_;
+
+        void load();
+    };
+
+    typedef std::map<uint64_t, std::shared_ptr<Handle>> FilterLevel;
 
     std::vector<FilterLevel> filterLevels;
 };
@@ -0,0 +1,83 @@
+#include "hashlist.h"
+
+#include <algorithm>
+#include <new>
+
+HashLinkList::HashLinkList() {
+    reset();
+}
+
+HashLinkList::~HashLinkList() = default;
+
+void HashLinkList::reset() {
+    MemTable::reset();
+    const size_t nr_buckets = 1U << BUCKET_BITS;
+    char *memory = arena->allocate(nr_buckets * sizeof(std::atomic<Node *>));
+    buckets = reinterpret_cast<std::atomic<Node *> *>(memory);
+    for (size_t i = 0U; i < nr_buckets; ++i) {
+        new(&buckets[i]) std::atomic<Node *>(nullptr);
+    }
+    nr_nodes = 0U;
+    std::lock_guard<std::mutex> lock(sorted_mutex);
+    sorted.reset();
+}
+
+HashLinkList::Slot *HashLinkList::find(uint64_t key) const {
+    Node *current = buckets[bucket(key)].load(std::memory_order_acquire);
+    while (current != nullptr && current->get_key() < key) {
+        current = current->get_next();
+    }
+    return current != nullptr && current->get_key() == key ? current->get_slot() : nullptr;
+}
+
+HashLinkList::Slot *HashLinkList::insert(uint64_t key, const Record *record, bool &inserted) {
+    std::atomic<Node *> *prev = &buckets[bucket(key)];
+    Node *node = nullptr;
+    while (true) {
+        // other writers may have linked nodes after prev meanwhile
+        Node *next = prev->load(std::memory_order_acquire);
+        while (next != nullptr && next->get_key() < key) {
+            prev = next->get_link();
+            next = next->get_next();
+        }
+        if (next != nullptr && next->get_key() == key) {
+            // a node allocated by a failed attempt stays unused in the arena
+            inserted = false;
+            return next->get_slot();
+        }
+        if (node == nullptr) {
+            node = new(arena->allocate(sizeof(Node))) Node(key, record);
+        }
+        node->set_next(next);
+        if (prev->compare_exchange_strong(next, node, std::memory_order_acq_rel)) {
+            ++nr_nodes;
+            inserted = true;
+            return node->get_slot();
+        }
+    }
+}
+
+std::unique_ptr<::Iterator> HashLinkList::iterator() const {
+    std::lock_guard<std::mutex> lock(sorted_mutex);
+    if (sorted == nullptr || sorted->size() != nr_nodes.load()) {
+        auto nodes = std::make_shared<Sorted>();
+        nodes->reserve(nr_nodes.load());
+        for (size_t i = 0U; i < (1U << BUCKET_BITS); ++i) {
+            for (const Node *node = buckets[i].load(std::memory_order_acquire); node != nullptr;
+                 node = node->get_next()) {
+                nodes->push_back(node);
+            }
+        }
+        std::sort(nodes->begin(), nodes->end(), [](const Node *a, const Node *b) {
+            return a->get_key() < b->get_key();
+        });
+        sorted = std::move(nodes);
+    }
+    return std::make_unique<Iterator>(arena, sorted);
+}
+
+void HashLinkList::Iterator::seek(uint64_t target) {
+    current_ = std::lower_bound(nodes_->begin(), nodes_->end(), target, [](const Node *node, uint64_t key) {
+        return node->get_key() < key;
+    }) - nodes_->begin();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "memtable.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * A hash table of sorted linked lists, one per bucket. A point lookup walks a single short list,
+ * while the first ordered iterator after an insert has to collect and sort every key.
+ * Writers link nodes with compare-and-swap, point lookups never wait.
+ */
+class HashLinkList : public MemTable {
+    class Node {
+    public:
+        Node(uint64_t key, const Record *record) : key_(key), record_(record), next_(nullptr) {}
+
+        [[nodiscard]] uint64_t get_key() const { return key_; }
+
+        [[nodiscard]] Slot *get_slot() { return &record_; }
+
+        [[nodiscard]] const Record *get_record() const { return record_.load(std::memory_order_acquire); }
+
+        [[nodiscard]] Node *get_next() const { return next_.load(std::memory_order_acquire); }
+
+        [[nodiscard]] std::atomic<Node *> *get_link() { return &next_; }
+
+        // only before the node is published
+        void set_next(Node *node) { next_.store(node, std::memory_order_relaxed); }
+
+    private:
+        uint64_t key_;
+        Slot record_;
+        std::atomic<Node *> next_;
+    };
+
+    // the nodes sorted by key, shared by the iterators until a key is added
+    typedef std::vector<const Node *> Sorted;
+
+    class Iterator : public ::Iterator {
+    public:
+        Iterator(std::shared_ptr<const Arena> arena, std::shared_ptr<const Sorted> nodes)
+                : arena_(std::move(arena)), nodes_(std::move(nodes)), current_(nodes_->size()) {}
+
+        [[nodiscard]] bool valid() const override { return current_ < nodes_->size(); }
+
+        void seek(uint64_t target) override;
+
+        void next() override { ++current_; }
+
+        [[nodiscard]] uint64_t key() const override { return (*nodes_)[current_]->get_key(); }
+
+        [[nodiscard]] std::string_view value() const override { return (*nodes_)[current_]->get_record()->value_; }
+
+        [[nodiscard]] bool is_deleted() const override { return (*nodes_)[current_]->get_record()->deleted_; }
+
+    private:
+        // keeps the nodes alive
+        std::shared_ptr<const Arena> arena_;
+        std::shared_ptr<const Sorted> nodes_;
+        size_t current_;
+    };
+
+public:
+    HashLinkList();
+
+    ~HashLinkList() override;
+
+    void reset() override;
+
+    [[nodiscard]] std::unique_ptr<::Iterator> iterator() const override;
+
+    // a memtable of 2MB holds tens of thousands of small values
+    static const int BUCKET_BITS = 16;
+
+protected:
+    [[nodiscard]] Slot *find(uint64_t key) const override;
+
+    Slot *insert(uint64_t key, const Record *record, bool &inserted) override;
+
+private:
+    // allocated in the arena
+    std::atomic<Node *> *buckets{nullptr};
+
+    std::atomic<size_t> nr_nodes{0U};
+
+    // keys are never removed, so the sorted nodes are complete as long as no node is added,
+    // which is always the case for an immutable memtable
+    mutable std::mutex sorted_mutex;
+    mutable std::shared_ptr<const Sorted> sorted;
+
+    [[nodiscard]] static size_t bucket(uint64_t key) {
+        // Fibonacci hashing, the top bits of the product are well mixed
+        return static_cast<size_t>((key * 0x9e3779b97f4a7c15ULL) >> (64 - BUCKET_BITS));
+    }
+};
@@ -1,63 +1,82 @@
 #include "index.h"
-#include <iostream>
+#include "search.h"
+#include "table.h"
+#include <algorithm>
 #include <filesystem>
-#include <chrono>
-#include <fstream>
 
 namespace fs = std::filesystem;
 
-void Index::get(uint64_t key, int &level, uint64_t &filename, uint64_t &offset, uint64_t &length, bool &deleted) const {
-    if (levels.empty()) {
-        return;
-    }
-    // search top-down
-    for (level = 0; level < maxLevel; ++level) {
-        // search from the latest one
-        for (auto &indexKV: levels[level]) {
-            uint64_t timestamp = indexKV.first;
-            auto iter = indexKV.second->find(key);
-            // if key found in this file
-            if (iter != indexKV.second->end()) {
-                filename = timestamp;
-                offset = iter->second->offset_;
-                length = iter->second->length_;
-                deleted = iter->second->deleted_;
-                return;
-            }
-        }
+IndexTable::IndexTable(uint64_t min_key, uint64_t max_key, uint64_t size, const std::vector<IndexNode> &nodes)
+        : min_key_(min_key), max_key_(max_key), size_(size) {
+    keys_.reserve(nodes.size());
+    offsets_.reserve(nodes.size());
+    lengths_.reserve(nodes.size());
+    for (auto &node: nodes) {
+        keys_.push_back(node.get_key());
+        offsets_.push_back(node.get_offset());
+        lengths_.push_back(static_cast<uint32_t>(node.get_length()));
     }
 }
 
-bool Index::find(uint64_t key) {
-    for (auto &level: levels) {
-        for (auto &pair: level) {
-            std::shared_ptr<IndexTree> tree = pair.second;
-            auto iter = tree->find(key);
-            // if key in disk and not marked as deleted
-            if (iter != tree->end() && !(iter->second->is_deleted())) {
-                return true;
-            }
-        }
+bool IndexTable::find(uint64_t key, size_t &block) const {
+    if (!in_range(key)) {
+        return false;
     }
-    return false;
+    // the first block whose last key >= key
+    block = branchless_lower_bound(keys_.data(), keys_.size(), key);
+    return block < keys_.size();
 }
 
-void
-Index::put(uint64_t key, int level, const std::string &filename, uint64_t offset, uint64_t length,
-           std::time_t timestamp, bool deleted) {
-    if (level > maxLevel) {
+void Index::put(int level, uint64_t filename, std::shared_ptr<IndexTable> table) {
+    if (level >= maxLevel) {
         return;
     }
-    // if file not existed, create it
-    if (levels[level].count(std::stoull(filename)) == 0) {
-        (void) levels[level].insert({std::stoull(filename), std::make_shared<IndexTree>()});
+    levels[level][filename] = std::move(table);
+    update_bounds(level);
+}
+
+void Index::erase(int level, uint64_t filename) {
+    (void) levels[level].erase(filename);
+    update_bounds(level);
+}
+
+const IndexTable *Index::find(size_t level, uint64_t key, uint64_t &filename) const {
+    const Bounds &b = bounds[level];
+    size_t i = branchless_lower_bound(b.max_keys_.data(), b.max_keys_.size(), key);
+    if (i == b.max_keys_.size() || b.min_keys_[i] > key) {
+        return nullptr;
+    }
+    filename = b.filenames_[i];
+    return b.tables_[i];
+}
+
+void Index::update_bounds(int level) {
+    // levels hold a handful of tables, so a full rebuild is cheap
+    std::vector<const IndexLevel::value_type *> entries;
+    entries.reserve(levels[level].size());
+    for (auto &entry: levels[level]) {
+        entries.push_back(&entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](auto *a, auto *b) {
+        return a->second->get_max_key() < b->second->get_max_key();
+    });
+
+    Bounds &b = bounds[level];
+    b = Bounds();
+    for (auto *entry: entries) {
+        if (!b.max_keys_.empty() && entry->second->get_min_key() <= b.max_keys_.back()) {
+            b.disjoint_ = false;
+        }
+        b.max_keys_.push_back(entry->second->get_max_key());
+        b.min_keys_.push_back(entry->second->get_min_key());
+        b.filenames_.push_back(entry->first);
+        b.tables_.push_back(entry->second.get());
     }
-    auto &tree = levels[level][std::stoull(filename)];
-    (void) tree->insert({key, std::make_shared<IndexNode>(offset, length, timestamp, deleted)});
 }
 
 Index::Index(const std::string &dir) : dir_(dir) {
     levels = std::vector<IndexLevel>(maxLevel, IndexLevel());
+    bounds = std::vector<Bounds>(maxLevel, Bounds());
 }
 
 Index::~Index() = default;
@@ -65,56 +84,43 @@ Index::~Index() = default;
 void Index::reset() {
     levels.clear();
     levels = std::vector<IndexLevel>(maxLevel, IndexLevel());
+    bounds = std::vector<Bounds>(maxLevel, Bounds());
 }
 
-void Index::recover(Filter &filter) {
+uint64_t Index::recover(Filter &filter) {
+    uint64_t last_filename = 0U;
     if (!fs::exists(dir_)) {
-        return;
+        return last_filename;
     }
     for (auto &p: fs::recursive_directory_iterator(dir_)) {
         if (fs::is_directory(p)) {
             continue;
         }
-        std::string path = p.path().string();
-        std::ifstream file(path, std::ios::in | std::ios::binary);
-
-        // get number of key-value pairs in the last 2 bytes
-        uint64_t n = 0U;
-        (void) file.seekg(-sizeof(uint64_t), std::ios_base::end);
-        (void) file.read(reinterpret_cast<char *>(&n), sizeof(uint64_t));
-
-        std::size_t pos = path.find(fs::path::preferred_separator);
-        path = path.substr(pos + 1U, path.size());
-
-        if (path == "wal" || path == "immwal") {
+        // sstables are stored as <dir>/<level>/<filename>, skip the wal files
+        const fs::path &path = p.path();
+        if (path.parent_path() == fs::path(dir_)) {
             continue;
         }
+        // a table that was being written when the store stopped, its data is still in a wal or in its inputs
+        if (path.extension() == ".tmp") {
+            (void) fs::remove(path);
+            continue;
+        }
+        int level = std::stoi(path.parent_path().filename().string());
+        uint64_t filename = std::stoull(path.filename().string());
+        last_filename = std::max(last_filename, filename);
 
-        for (uint64_t i = 1U; i <= n; i++) {
-            // recover key
-            uint64_t key;
-            (void) file.seekg((int) (-sizeof(uint64_t) * (1U + 2U * i)), std::ios_base::end);
-            (void) file.read(reinterpret_cast<char *>(&key), sizeof(uint64_t));
-            // recover offset
-            uint64_t offset = 0U;
-            (void) file.seekg((int) (-sizeof(uint64_t) * (2U * i)), std::ios_base::end);
-            (void) file.read(reinterpret_cast<char *>(&offset), sizeof(uint64_t));
-            // recover value
-            std::string s;
-            (void) file.seekg(offset + sizeof(uint64_t));
-            (void) std::getline(file, s, '\0');
-
-            pos = path.find(fs::path::preferred_separator);
-            int level = std::stoi(path.substr(0, pos));
-            std::string filename = path.substr(pos + 1, path.size());
-
-            put(key, level, filename, offset, s.size(), std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch()
-            ).count(), false);
-
-            // sync with filter
-            filter.add(key, level, std::stoull(filename));
+        // only the footer, the meta block and the index block are read
+        uint64_t filter_offset = 0U;
+        uint64_t filter_length = 0U;
+        std::shared_ptr<IndexTable> table = TableReader::open(path.string(), filter_offset, filter_length);
+        if (table == nullptr) {
+            continue;
         }
-        file.close();
+        put(level, filename, table);
+
+        // sync with filter, whose bits stay on disk until the first probe
+        filter.recover(level, filename, path.string(), filter_offset, filter_length);
     }
+    return last_filename;
 }
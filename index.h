@@ -1,6 +1,6 @@
 #pragma once
 
-#include <ctime>
+#include <cstdint>
 #include <map>
 #include <vector>
 #include <string>
@@ -8,36 +8,74 @@
 
 #include "filter.h"
 
+/**
+ * Location of a data block in an sstable. The key is the largest key stored in the block.
+ */
 class IndexNode {
 public:
-    IndexNode(uint64_t offset,
-              uint64_t length,
-              std::time_t timestamp,
-              bool deleted
-    ) : offset_(offset),
-        length_(length),
-        timestamp_(timestamp),
-        deleted_(deleted) {}
+    IndexNode(uint64_t key,
+              uint64_t offset,
+              uint64_t length
+    ) : key_(key),
+        offset_(offset),
+        length_(length) {}
+
+    [[nodiscard]] uint64_t get_key() const { return key_; }
 
     [[nodiscard]] uint64_t get_offset() const { return offset_; }
 
     [[nodiscard]] uint64_t get_length() const { return length_; }
 
-    [[nodiscard]] std::time_t get_timestamp() const { return timestamp_; }
-
-    [[nodiscard]] bool is_deleted() const { return deleted_; }
-
 private:
-    friend class Index;
-
+    uint64_t key_;
     uint64_t offset_;
     uint64_t length_;
-    std::time_t timestamp_;
-    bool deleted_;
 };
 
-typedef std::map<uint64_t, std::shared_ptr<IndexNode>> IndexTree;                  // key -> node info
-typedef std::map<uint64_t, std::shared_ptr<IndexTree>, std::greater<>> IndexLevel; // filename -> index tree
+/**
+ * The in-memory part of an sstable: its sparse block index and its metadata.
+ * The block index is immutable, so it is packed into parallel arrays instead of a vector of nodes:
+ * the search only touches the array of last keys.
+ */
+class IndexTable {
+public:
+    IndexTable() = default;
+
+    IndexTable(uint64_t min_key, uint64_t max_key, uint64_t size, const std::vector<IndexNode> &nodes);
+
+    [[nodiscard]] uint64_t get_min_key() const { return min_key_; }
+
+    [[nodiscard]] uint64_t get_max_key() const { return max_key_; }
+
+    // number of key-value pairs in the table
+    [[nodiscard]] uint64_t get_size() const { return size_; }
+
+    // number of data blocks
+    [[nodiscard]] size_t get_nr_blocks() const { return keys_.size(); }
+
+    [[nodiscard]] IndexNode get_node(size_t i) const { return {keys_[i], offsets_[i], lengths_[i]}; }
+
+    [[nodiscard]] bool in_range(uint64_t key) const { return key >= min_key_ && key <= max_key_; }
+
+    // the only block that may contain the key, false if the key is out of range
+    [[nodiscard]] bool find(uint64_t key, size_t &block) const;
+
+    // bytes held by the block index
+    [[nodiscard]] size_t get_memory_usage() const {
+        return keys_.capacity() * sizeof(uint64_t) + offsets_.capacity() * sizeof(uint64_t) +
+               lengths_.capacity() * sizeof(uint32_t);
+    }
+
+private:
+    uint64_t min_key_{0U};
+    uint64_t max_key_{0U};
+    uint64_t size_{0U};
+    std::vector<uint64_t> keys_;
+    std::vector<uint64_t> offsets_;
+    std::vector<uint32_t> lengths_;
+};
+
+typedef std::map<uint64_t, std::shared_ptr<IndexTable>, std::greater<>> IndexLevel; // filename -> table
 
 class Index {
 public:
@@ -45,31 +83,46 @@ public:
 
     ~Index();
 
-    void get(uint64_t key,
-             int &level,
-             uint64_t &filename,
-             uint64_t &offset,
-             uint64_t &length,
-             bool &deleted) const;
+    void put(int level, uint64_t filename, std::shared_ptr<IndexTable> table);
 
-    void put(uint64_t key,
-             int level,
-             const std::string &filename,
-             uint64_t offset,
-             uint64_t length,
-             std::time_t timestamp,
-             bool deleted);
-
-    bool find(uint64_t key);
+    void erase(int level, uint64_t filename);
 
     void reset();
 
-    void recover(Filter &filter);
+    // returns the largest filename found, new tables must be named after it
+    uint64_t recover(Filter &filter);
 
     IndexLevel &get_level(size_t level) { return levels[level]; }
 
+    [[nodiscard]] const IndexLevel &get_level(size_t level) const { return levels[level]; }
+
+    // whether the tables of the level have disjoint key ranges
+    [[nodiscard]] bool is_disjoint(size_t level) const { return bounds[level].disjoint_; }
+
+    /**
+     * The only table of a disjoint level whose key range contains the key, nullptr if there is none.
+     * Binary search over the boundaries of the level, which does not depend on the number of tables.
+     */
+    [[nodiscard]] const IndexTable *find(size_t level, uint64_t key, uint64_t &filename) const;
+
 private:
+    /**
+     * Key ranges of the tables in a level, sorted by max key.
+     * A level is disjoint if every min key is greater than the max key before it.
+     */
+    struct Bounds {
+        std::vector<uint64_t> max_keys_;
+        std::vector<uint64_t> min_keys_;
+        std::vector<uint64_t> filenames_;
+        std::vector<const IndexTable *> tables_;
+        bool disjoint_{true};
+    };
+
     const std::string &dir_;
     std::vector<IndexLevel> levels;
+    std::vector<Bounds> bounds;
     const int maxLevel = 20;
+
+    // rebuild the bounds after the tables of a level change
+    void update_bounds(int level);
 };
@@ -0,0 +1,33 @@
+/**
+ * A cursor over a sorted sequence of key-value pairs, e.g. a memtable or an sstable
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+class Iterator {
+public:
+    Iterator() = default;
+
+    Iterator(const Iterator &) = delete;
+
+    Iterator &operator=(const Iterator &) = delete;
+
+    virtual ~Iterator() = default;
+
+    [[nodiscard]] virtual bool valid() const = 0;
+
+    // position at the first key >= target
+    virtual void seek(uint64_t target) = 0;
+
+    virtual void next() = 0;
+
+    [[nodiscard]] virtual uint64_t key() const = 0;
+
+    // valid until the iterator moves or is destroyed
+    [[nodiscard]] virtual std::string_view value() const = 0;
+
+    [[nodiscard]] virtual bool is_deleted() const = 0;
+};
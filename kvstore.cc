@@ -1,55 +1,154 @@
 #include "kvstore.h"
-#include "batch.h"
+#include "merger.h"
 #include <future>
 #include <functional>
-#include <fstream>
 #include <filesystem>
 #include <algorithm>
+#include <cmath>
 
 namespace fs = std::filesystem;
 
-KVStore::KVStore(const std::string &dir) : KVStoreAPI(dir), dir_(dir), memtable(), index(dir), disk(dir), filter() {
+KVStore::KVStore(const std::string &dir, const Options &options)
+        : KVStoreAPI(dir), dir_(dir), options_(options), memtable(MemTable::create(options_.memtable_kind)),
+          index(dir_), disk(dir_, options_), filter(), wal_writer_(options_.wal_sync, options_.wal_sync_interval_ms) {
     // maximum num of files are 2, 4, 8, 16, 32, ...
     for (int i = 0; i < maxLevel; ++i) {
         maxFileNums[i] = 1U << (i + 1);
     }
+    (void) fs::create_directories(dir_);
+    // the recovered immutable memtables are flushed in the background, after the sstables are known
+    // a restart within the same millisecond as the last table, or after the clock went back, must not reuse a name
+    lastFilename = index.recover(filter);
     recover_memtable();
-    index.recover(filter);
 }
 
-KVStore::~KVStore() = default;
+KVStore::~KVStore() {
+    // the queued flushes still use the store
+    std::shared_future<void>(flush).wait();
+}
 
 /**
  * Insert/Update the key-value pair.
  * No return values for simplicity.
  */
 void KVStore::put(uint64_t key, const std::string &s) {
-    wal("put", key, s);
-    memtable.put(key, s);
-    // if memtable is full
-    if (memtable.getSize() >= MAX_MEMTABLE_SIZE) {
-        std::string walname = "wal";
-        fs::path walpath = dir_;
-        walpath /= walname;
-        std::string immwalname = "immwal";
-        fs::path immwalpath = dir_;
-        immwalpath /= immwalname;
-        // wait for the flush to finish
-        flush.wait();
-        // move memtable to immutable memtable
-        imm_memtable = std::move(memtable);
-        if (fs::exists(dir_)) {
-            if (fs::exists(immwalpath)) {
-                // remove immutable wal
-                fs::remove(immwalname);
-            }
-            if (fs::exists(walpath)) {
-                // rename wal to immwal
-                fs::rename(walpath, immwalpath);
-            }
+    std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+    if (!is_writable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> key_lock(key_mutex(key));
+        // a write the wal does not hold would be lost by a restart, while the later ones would not
+        if (!wal(WalRecordType::PUT, key, s)) {
+            return;
         }
-        flush = std::async(std::launch::async, std::bind(&KVStore::write_to_disk, this, 0, imm_memtable.traverse()));
-        memtable.reset();
+        memtable->put(key, s);
+    }
+    if (memtable_full()) {
+        lock.unlock();
+        switch_memtable();
+    }
+}
+
+bool KVStore::memtable_full() const {
+    return memtable->getSize() >= MAX_MEMTABLE_SIZE || memtable->get_memory_usage() >= MAX_MEMTABLE_MEMORY;
+}
+
+void KVStore::switch_memtable() {
+    std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+    // another writer may have switched it first, and the queue is not flushed once a flush failed
+    if (!memtable_full() || !is_writable()) {
+        return;
+    }
+    // stall while the queue is full, without the lock, which the flushes need to finish
+    while (imm_memtables.size() >= std::max<size_t>(options_.max_immutable_memtables, 1U)) {
+        std::shared_future<void> oldest = imm_memtables.back().flushed_;
+        lock.unlock();
+        oldest.wait();
+        lock.lock();
+        if (!memtable_full() || !is_writable()) {
+            return;
+        }
+    }
+    // no writer appends to the wal without the lock, the segment stays with its memtable until it is flushed
+    wal_writer_.close();
+    // move memtable to the queue of immutable memtables
+    queue_flush(std::move(memtable), wal_path_);
+    memtable = MemTable::create(options_.memtable_kind);
+    open_wal();
+}
+
+void KVStore::queue_flush(std::shared_ptr<MemTable> imm, const std::string &walpath) {
+    flush = std::async(std::launch::async, &KVStore::flush_memtable, this, imm, walpath, flush);
+    imm_memtables.push_front({std::move(imm), flush});
+}
+
+void KVStore::open_wal() {
+    (void) fs::create_directories(dir_);
+    // the data directory may have been removed under the store
+    while (!free_wals_.empty() && !fs::exists(free_wals_.back())) {
+        free_wals_.pop_back();
+    }
+    if (free_wals_.empty()) {
+        wal_path_ = (fs::path(dir_) / ("wal." + std::to_string(++last_wal_file_))).string();
+    } else {
+        wal_path_ = free_wals_.back();
+        free_wals_.pop_back();
+    }
+    // a memtable is full at about MAX_MEMTABLE_SIZE, the segment grows past it if needed
+    (void) wal_writer_.open(wal_path_, ++last_wal_seq_, MAX_MEMTABLE_SIZE);
+}
+
+void KVStore::recycle_wal(const std::string &walpath) {
+    // enough for the memtables switched while the queue is flushed
+    if (free_wals_.size() < std::max<size_t>(options_.max_immutable_memtables, 1U)) {
+        free_wals_.push_back(walpath);
+    } else {
+        (void) fs::remove(walpath);
+    }
+}
+
+void KVStore::flush_memtable(std::shared_ptr<MemTable> imm, std::string walpath,
+                             std::shared_future<void> previous) {
+    // level 0 tables are searched from the latest one, so flush in order
+    previous.wait();
+    // nor keep the older flushes alive
+    previous = std::shared_future<void>();
+    // a newer memtable must not be flushed before an older one that failed, its table would be searched first
+    if (!is_writable()) {
+        return;
+    }
+    bool written = false;
+    {
+        // the entries are written as they are iterated, without a copy of the memtable
+        std::unique_ptr<Iterator> iter = imm->iterator();
+        written = write_to_disk(0, *iter);
+    }
+    if (!written) {
+        // the memtable stays searched, and its wal is kept to recover it on the next start
+        writable_.store(false, std::memory_order_release);
+        return;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+        // the oldest one, now searched in its sstable
+        imm_memtables.pop_back();
+    }
+    // the arena is freed unless readers still pin values of it
+    imm.reset();
+    // a segment left live is replayed by the next start into a level 0 table newer than those of the later
+    // memtables, whose values it would hide, so none of them is flushed
+    if (!release_wal_segment(walpath)) {
+        writable_.store(false, std::memory_order_release);
+        return;
+    }
+    {
+        std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+        recycle_wal(walpath);
+    }
+
+    if (index.get_level(0).size() > maxFileNums[0]) {
+        compact(0);
     }
 }
 
@@ -58,36 +157,79 @@ void KVStore::put(uint64_t key, const std::string &s) {
  * An empty string indicates not found.
  */
 std::string KVStore::get(uint64_t key) const {
-    bool mem_deleted = false;
-    bool mem_found = true;
-    const std::string &value = memtable.get(key, mem_deleted, mem_found);
-    if (mem_found) {
-        return value;
-    }
-    // if not found in memtable, find in immutable memtable
-    if (imm_memtable.getSize() > 0) {
-        bool imm_deleted = false;
-        bool imm_found = true;
-        const std::string &value = imm_memtable.get(key, imm_deleted, imm_found);
-        if (imm_found) {
-            return value;
+    PinnableValue value;
+    if (!get(key, value)) {
+        return {};
+    }
+    return value.to_string();
+}
+
+/**
+ * Returns whether the key is found. The value is not copied,
+ * it stays valid as long as the PinnableValue is neither reset nor destroyed.
+ */
+bool KVStore::get(uint64_t key, PinnableValue &value) const {
+    std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+    bool deleted = false;
+    if (memtable->get(key, value, deleted)) {
+        return !deleted;
+    }
+    // if not found in memtable, find in immutable memtables from the newest
+    for (auto &imm: imm_memtables) {
+        if (imm.memtable_->get(key, value, deleted)) {
+            return !deleted;
         }
     }
-    // if not found in immutable memtable, find in index
-    int level = -1;
-    uint64_t filename;
-    uint64_t offset = UINT64_MAX;
-    uint64_t length = 0U;
-    bool index_deleted = false;
-    index.get(key, level, filename, offset, length, index_deleted);
-    if (offset == UINT64_MAX || index_deleted) {
-        return {};
+    // if not found in immutable memtables, find in sstables
+    if (get_from_disk(key, value, deleted)) {
+        return !deleted;
     }
-    if (!filter.contains(key, level, filename)) {
-        return {};
+    value.reset();
+    return false;
+}
+
+bool KVStore::get_from_disk(uint64_t key, PinnableValue &value, bool &deleted) const {
+    // hash once for the filters of every table
+    const uint64_t h = BloomFilter::hash(key);
+    // search top-down
+    for (int level = 0; level < maxLevel; ++level) {
+        if (index.is_disjoint(level)) {
+            // at most one table of the level may hold the key
+            uint64_t filename = 0U;
+            const IndexTable *table = index.find(level, key, filename);
+            if (table != nullptr && get_from_table(key, h, level, filename, *table, value, deleted)) {
+                return true;
+            }
+            continue;
+        }
+        // tables overlap, search from the latest one
+        for (auto &indexKV: index.get_level(level)) {
+            if (get_from_table(key, h, level, indexKV.first, *indexKV.second, value, deleted)) {
+                return true;
+            }
+        }
     }
-    // get in disk
-    return disk.get(level, filename, offset, length);
+    return false;
+}
+
+bool KVStore::get_from_table(uint64_t key, uint64_t h, int level, uint64_t filename, const IndexTable &table,
+                             PinnableValue &value, bool &deleted) const {
+    // probe the filter before the block index, so that an absent key costs no index search
+    if (!table.in_range(key) || !filter.contains(h, level, filename)) {
+        return false;
+    }
+    size_t node = 0U;
+    if (!table.find(key, node)) {
+        return false;
+    }
+    std::shared_ptr<Block> block = disk.get(level, filename, table.get_node(node));
+    std::string_view view;
+    if (block == nullptr || !block->get(key, view, deleted)) {
+        return false;
+    }
+    // pin the block, which may be evicted from the block cache meanwhile
+    value.pin(view, block);
+    return true;
 }
 
 /**
@@ -98,62 +240,38 @@ std::string KVStore::get(uint64_t key) const {
  */
 void KVStore::scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_t, std::string>> &result) const {
     result.clear();
-    std::map<uint64_t, const std::string> kv;
-    std::map<std::pair<int, uint64_t>, Batch> batches;
-    // a batch is a collection of information (key, offset, length) in a file
-    // we combine multiple readings of a file into one
-    // we must wait for the flush to finish, otherwise the immutable and file may be both empty
-    flush.wait();
-    for (uint64_t key = lower; key <= upper; key++) {
-        bool mem_deleted = false;
-        bool mem_found = true;
-        const std::string &value = memtable.get(key, mem_deleted, mem_found);
-        if (mem_found) {
-            if (!value.empty()) {
-                (void) kv.insert({key, value});
-            }
-            continue;
-        }
-        // if not found in memtable, find in immutable memtable
-        if (imm_memtable.getSize() > 0) {
-            bool imm_deleted = false;
-            bool imm_found = true;
-            const std::string &value = memtable.get(key, imm_deleted, imm_found);
-            if (imm_found) {
-                if (!value.empty()) {
-                    (void) kv.insert({key, value});
-                }
+    if (lower > upper) {
+        return;
+    }
+    // an immutable memtable stays queued until its sstable is installed, so no flush needs to be waited for
+    std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+    // merge the memtable, the immutable memtables and every sstable, from the newest to the oldest,
+    // so that the cost depends on the number of entries in range instead of the width of the range
+    std::vector<std::unique_ptr<Iterator>> children;
+    (void) children.emplace_back(memtable->iterator());
+    for (auto &imm: imm_memtables) {
+        (void) children.emplace_back(imm.memtable_->iterator());
+    }
+    for (int level = 0; level < maxLevel; ++level) {
+        // from the latest file to the oldest one, skipping the tables that hold no key in range
+        for (auto &indexKV: index.get_level(level)) {
+            const IndexTable &table = *indexKV.second;
+            if (table.get_max_key() < lower || table.get_min_key() > upper ||
+                !filter.may_contain(lower, upper, level, indexKV.first)) {
                 continue;
             }
+            (void) children.emplace_back(disk.iterator(level, indexKV.first, indexKV.second));
         }
-        // if not found in immutable memtable, find in index
-        int level = -1;
-        uint64_t filename;
-        uint64_t offset = UINT64_MAX;
-        uint64_t length = 0U;
-        bool index_deleted = false;
-        index.get(key, level, filename, offset, length, index_deleted);
-        if (offset == UINT64_MAX || index_deleted) {
-            continue;
-        }
-        if (!filter.contains(key, level, filename)) {
-            continue;
-        }
-        if (batches.count({level, filename}) == 0U) {
-            (void) batches.insert({{level, filename}, Batch(level, filename)});
-        }
-        (void) batches.at({level, filename}).infos_.insert({key, offset, length});
     }
-    for (auto &it: batches) {
-        disk.get(it.second, kv);
-    }
-    for (auto &it: kv) {
-        (void) result.emplace_back(it.first, it.second);
+    MergingIterator iter(std::move(children));
+    for (iter.seek(lower); iter.valid() && iter.key() <= upper; iter.next()) {
+        if (!iter.is_deleted()) {
+            std::string_view value = iter.value();
+            if (!value.empty()) {
+                (void) result.emplace_back(iter.key(), std::string(value));
+            }
+        }
     }
-    std::sort(result.begin(), result.end(), [](const std::pair<uint64_t, std::string> &a,
-                                               const std::pair<uint64_t, std::string> &b) {
-        return a.first < b.first;
-    });
 }
 
 /**
@@ -161,38 +279,36 @@ void KVStore::scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_
  * Returns false iff the key is not found.
  */
 bool KVStore::del(uint64_t key) {
-    wal("del", key, "");
-    bool in_index = index.find(key);
-
-    bool imm_deleted = false;
-    bool imm_found = true;
-    const std::string &s = imm_memtable.get(key, imm_deleted, imm_found);
-    bool in_immutable = imm_found && !imm_deleted;
-    bool success = memtable.del(key, in_index, in_immutable, !imm_found);
-    // if memtable is full
-    if (memtable.getSize() >= MAX_MEMTABLE_SIZE) {
-        std::string walname = "wal";
-        fs::path walpath = dir_;
-        walpath /= walname;
-        std::string immwalname = "immwal";
-        fs::path immwalpath = dir_;
-        immwalpath /= immwalname;
-        // wait for the flush to finish
-        flush.wait();
-        // move memtable to immutable memtable
-        imm_memtable = std::move(memtable);
-        if (fs::exists(dir_)) {
-            if (fs::exists(immwalpath)) {
-                // remove immutable wal
-                fs::remove(immwalname);
-            }
-            if (fs::exists(walpath)) {
-                // rename wal to immwal
-                fs::rename(walpath, immwalpath);
+    std::shared_lock<std::shared_mutex> lock(memtable_mutex_);
+    if (!is_writable()) {
+        return false;
+    }
+    std::unique_lock<std::mutex> key_lock(key_mutex(key));
+    if (!wal(WalRecordType::DEL, key, std::string_view())) {
+        return false;
+    }
+    PinnableValue value;
+    bool deleted = false;
+    // the newest table holding the key decides, the sstables are searched only if no memtable holds it
+    bool imm_found = false;
+    bool in_index = false;
+    if (!memtable->get(key, value, deleted)) {
+        for (auto &imm: imm_memtables) {
+            if (imm.memtable_->get(key, value, deleted)) {
+                imm_found = true;
+                break;
             }
         }
-        flush = std::async(std::launch::async, std::bind(&KVStore::write_to_disk, this, 0, imm_memtable.traverse()));
-        memtable.reset();
+        if (!imm_found) {
+            in_index = get_from_disk(key, value, deleted) && !deleted;
+        }
+    }
+    bool in_immutable = imm_found && !deleted;
+    bool success = memtable->del(key, in_index, in_immutable, !imm_found);
+    key_lock.unlock();
+    if (memtable_full()) {
+        lock.unlock();
+        switch_memtable();
     }
     return success;
 }
@@ -202,84 +318,109 @@ bool KVStore::del(uint64_t key) {
  * including memtable and all sstables files.
  */
 void KVStore::reset() {
-    memtable.reset();
+    // the queued flushes take the lock to finish
+    std::shared_future<void>(flush).wait();
+    std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+    memtable->reset();
+    // the memtables whose flush failed
+    imm_memtables.clear();
+    writable_.store(true, std::memory_order_release);
     index.reset();
     disk.reset();
     filter.reset();
 }
 
-void KVStore::print() const { memtable.print(); }
+void KVStore::print() const { memtable->print(); }
+
+bool KVStore::write_to_disk(int level, Iterator &iter) {
+    uint64_t filename = new_filename();
+    // the builder fails to open the table if the directory cannot be created
+    std::error_code ec;
+    (void) fs::create_directories(fs::path(disk.path(level, filename)).parent_path(), ec);
+    TableBuilder builder(disk.path(level, filename), bloom_bits_per_key(level), options_.bloom_kind,
+                         options_.range_filter_shift, options_.range_filter_bits_per_prefix);
+    for (iter.seek(0U); iter.valid(); iter.next()) {
+        builder.add(iter.key(), iter.value(), iter.is_deleted());
+    }
+    return install(level, filename, builder) != nullptr;
+}
 
-void KVStore::write_to_disk(int level, const Data &data) {
-    std::time_t fileTimestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+uint64_t KVStore::new_filename() {
+    // filenames are timestamps, which must be unique and increasing within a level
+    auto timestamp = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
             std::chrono::system_clock::now().time_since_epoch()
-    ).count();
-    std::string filename = std::to_string(fileTimestamp);
-    std::ofstream file;
-
-    fs::path path = dir_;
-    path /= std::to_string(level);
-    (void) fs::create_directories(path);
-    path /= filename;
-    file.open(path, std::ios::out | std::ios::binary);
-
-    std::vector<uint64_t> offsets;
-    std::vector<uint64_t> lengths;
-
-    for (auto &kv: data) {
-        // record offset and length
-        (void) offsets.emplace_back(file.tellp());
-        (void) lengths.emplace_back(kv.value_.size());
-
-        // write key and value
-        (void) file.write((char *) (&(kv.key_)), sizeof(uint64_t));
-        (void) file.write(kv.value_.c_str(), kv.value_.size());
-        (void) file.write("\0", sizeof(char));
+    ).count());
+    lastFilename = std::max(timestamp, lastFilename + 1U);
+    return lastFilename;
+}
 
-        (void) file.flush();
+/**
+ * Monkey-style allocation, see https://stratos.seas.harvard.edu/files/stratos/files/monkeykeyvaluestore.pdf
+ * Minimizing the sum of the false positive rates p_i of the levels, under the budget
+ * M == sum n_i * ln(1 / p_i) / ln(2)^2 for n_i keys in level i, gives p_i proportional to n_i.
+ * So bits per key drop by ln(T) / ln(2)^2 from a level to the next one T times larger.
+ *
+ * The bits of a table are fixed when it is written, so the levels are taken at their capacity, down to one
+ * level below the deepest in use, with as many keys per table as the tables hold on average. Their sizes at
+ * that time would give the level that happens to be the largest fewer bits than the deeper levels written
+ * later, and the tables written while the tree is smaller would spend the budget of the keys to come.
+ */
+uint32_t KVStore::bloom_bits_per_key(int level) const {
+    if (options_.bloom_memory_budget == 0U) {
+        return options_.bloom_bits_per_key;
     }
-
-    (void) file.flush();
-
-    uint64_t n = data.size();
-
-    for (uint64_t i = 0U; i < n; i++) {
-        uint64_t key = data[i].key_;
-        uint64_t offset = offsets[i];
-        uint64_t length = lengths[i];
-
-        // write key and offset
-        (void) file.write(reinterpret_cast<char *>(&key), sizeof(uint64_t));
-        (void) file.write(reinterpret_cast<char *>(&offset), sizeof(uint64_t));
-
-        (void) file.flush();
-
-        // sync with index
-        index.put(key, level, filename, offset, length, std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::system_clock::now().time_since_epoch()
-        ).count(), data[i].deleted_);
-
-        // sync with filter
-        filter.add(key, level, std::stoull(filename));
+    uint64_t nr_tables = 0U;
+    uint64_t nr_entries = 0U;
+    int deepest = level;
+    for (int i = 0; i < maxLevel; ++i) {
+        for (auto &indexKV: index.get_level(i)) {
+            nr_entries += indexKV.second->get_size();
+            ++nr_tables;
+            deepest = std::max(deepest, i);
+        }
     }
+    // nothing to size the levels by before the first table
+    if (nr_entries == 0U) {
+        return options_.bloom_bits_per_key;
+    }
+    const double entries_per_table = static_cast<double>(nr_entries) / static_cast<double>(nr_tables);
+    const int planned = std::min(deepest + 1, maxLevel - 1);
+    std::vector<double> entries(static_cast<size_t>(planned) + 1U, 0.0);
+    double total = 0.0;
+    double weighted = 0.0;
+    for (int i = 0; i <= planned; ++i) {
+        entries[i] = entries_per_table * static_cast<double>(maxFileNums[i]);
+        total += entries[i];
+        weighted += entries[i] * std::log(entries[i]);
+    }
+    // p_i == c * n_i, solve the budget for ln(1 / c)
+    const double ln2_2 = std::log(2.0) * std::log(2.0);
+    const double log_inv_c = (8.0 * static_cast<double>(options_.bloom_memory_budget) * ln2_2 + weighted) / total;
+    // a level whose p_i would reach 1 gets no useful filter
+    const double bits = (log_inv_c - std::log(entries[level])) / ln2_2;
+    return static_cast<uint32_t>(std::clamp(std::round(bits), 0.0, static_cast<double>(MAX_BLOOM_BITS_PER_KEY)));
+}
 
-    // write number of key-value pair for index recovery
-    (void) file.write(reinterpret_cast<char *>(&n), sizeof(uint64_t));
-
-    (void) file.flush();
-
-    file.close();
-
-    if (index.get_level(level).size() > maxFileNums[level]) {
-        compact(level);
+std::shared_ptr<IndexTable> KVStore::install(int level, uint64_t filename, TableBuilder &builder) {
+    std::shared_ptr<IndexTable> table = builder.finish();
+    if (table == nullptr) {
+        return nullptr;
     }
+    std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+    // sync with index
+    index.put(level, filename, table);
+    // sync with filter
+    filter.put(level, filename, builder.get_filter(), builder.get_range_filter());
+    return table;
 }
 
 void KVStore::compact(int level) {
-    // record information to merge
-    std::vector<MergeNode> toMerge;
+    // files to merge, from the latest to the oldest
+    std::vector<std::tuple<int, uint64_t, std::shared_ptr<IndexTable>>> toMerge;
 
-    Range range;
+    // key range of the files to merge in this level
+    uint64_t lower = UINT64_MAX;
+    uint64_t upper = 0U;
 
     // number of files to merge in this level
     size_t num;
@@ -289,199 +430,156 @@ void KVStore::compact(int level) {
         num = index.get_level(level).size() - maxFileNums[level];
     }
 
-    auto treeKV1 = index.get_level(level).begin();
+    std::vector<std::unique_ptr<Iterator>> children;
+
+    auto tableKV1 = index.get_level(level).begin();
 
     for (size_t i = 0; i < num; i++) {
-        uint64_t filename = treeKV1->first;
-        auto tree = treeKV1->second;
-        uint64_t lower = tree->begin()->first;
-        uint64_t upper = tree->rbegin()->first;
-        // ranges in this level
-        range.push_back({lower, upper});
-        (void) toMerge.emplace_back(MergeNode(level, filename, tree->begin()));
-        treeKV1++;
-    }
-
-    // search files to merge in the next level
-    for (auto &treeKV: index.get_level(level + 1)) {
-        uint64_t filename = treeKV.first;
-        auto tree = treeKV.second;
-        uint64_t lower = tree->begin()->first;
-        uint64_t upper = tree->rbegin()->first;
-        if (inRange(lower, upper, range)) {
-            (void) toMerge.emplace_back(MergeNode(level + 1, filename, tree->begin()));
-        }
+        uint64_t filename = tableKV1->first;
+        auto table = tableKV1->second;
+        lower = std::min(lower, table->get_min_key());
+        upper = std::max(upper, table->get_max_key());
+        (void) toMerge.emplace_back(level, filename, table);
+        // compaction inputs are read once, keep them out of the block cache
+        (void) children.emplace_back(disk.iterator(level, filename, table, false));
+        tableKV1++;
     }
 
-    struct cmp {
-        bool operator()(const MergeNode &a, const MergeNode &b) {
-            return a.iter_->first > b.iter_->first;
+    // search files to merge in the next level. Every file overlapping the whole range is merged, not only
+    // the files overlapping one of the inputs: the outputs span the whole range, and a file left in a gap
+    // between the inputs would overlap them and break the disjoint ranges of the next level.
+    for (auto &tableKV: index.get_level(level + 1)) {
+        uint64_t filename = tableKV.first;
+        auto table = tableKV.second;
+        if (table->get_min_key() <= upper && table->get_max_key() >= lower) {
+            (void) toMerge.emplace_back(level + 1, filename, table);
+            (void) children.emplace_back(disk.iterator(level + 1, filename, table, false));
         }
-    };
-
-    std::priority_queue<MergeNode, std::vector<MergeNode>, cmp> queue;
-
-    for (auto &node: toMerge) {
-        queue.push(node);
     }
 
-    Data data;
-    uint64_t size = 0U;
-
-    while (!queue.empty()) {
-        MergeNode latest = queue.top();
-        auto tmp = latest.iter_;
-        queue.pop();
-        auto tree = index.get_level(latest.level_)[latest.filename_];
-        if (++tmp != tree->end()) {
-            queue.push(MergeNode(latest.level_, latest.filename_, tmp));
+    // the latest version of every key wins
+    MergingIterator iter(std::move(children));
+
+    std::unique_ptr<TableBuilder> builder;
+    uint64_t filename = 0U;
+    // the tables written so far
+    std::vector<std::pair<uint64_t, std::shared_ptr<IndexTable>>> outputs;
+    bool written = true;
+
+    for (iter.seek(0U); written && iter.valid(); iter.next()) {
+        if (builder == nullptr) {
+            filename = new_filename();
+            std::error_code ec;
+            (void) fs::create_directories(fs::path(disk.path(level + 1, filename)).parent_path(), ec);
+            builder = std::make_unique<TableBuilder>(disk.path(level + 1, filename), bloom_bits_per_key(level + 1),
+                                                     options_.bloom_kind, options_.range_filter_shift,
+                                                     options_.range_filter_bits_per_prefix);
         }
-
-        uint64_t key = latest.iter_->first;
-        std::time_t timestamp = latest.iter_->second->get_timestamp();
-
-        if (!queue.empty()) {
-            MergeNode top = queue.top();
-            // find the latest one with the same key
-            while (!queue.empty() && queue.top().iter_ != latest.iter_ &&
-                   queue.top().iter_->first == key) {
-                if (queue.top().iter_->second->get_timestamp() >= timestamp) {
-                    latest = queue.top();
-                    timestamp = queue.top().iter_->second->get_timestamp();
-                }
-
-                auto tmp1 = queue.top();
-                queue.pop();
-
-                auto tree1 = index.get_level(tmp1.level_)[tmp1.filename_];
-                auto tmp2 = tmp1.iter_;
-                if (++tmp2 != tree1->end()) {
-                    queue.push(MergeNode(tmp1.level_, tmp1.filename_, tmp2));
-                }
-                top = queue.top();
-            }
+        builder->add(iter.key(), iter.value(), iter.is_deleted());
+        if (builder->get_file_size() >= MAX_FILE_SIZE) {
+            std::shared_ptr<IndexTable> table = install(level + 1, filename, *builder);
+            written = table != nullptr;
+            (void) outputs.emplace_back(filename, table);
+            builder = nullptr;
         }
+    }
+    if (written && builder != nullptr) {
+        std::shared_ptr<IndexTable> table = install(level + 1, filename, *builder);
+        written = table != nullptr;
+        (void) outputs.emplace_back(filename, table);
+    }
 
-        // have found the latest one, record it
-        key = latest.iter_->first;
-        std::string value =
-                disk.get(latest.level_, latest.filename_, latest.iter_->second->get_offset(),
-                         latest.iter_->second->get_length());
-        bool deleted = latest.iter_->second->is_deleted();
-
-        (void) data.emplace_back(DataNode(key, value, deleted));
-        size += sizeof(uint64_t) + value.size() + sizeof(uint64_t) + sizeof(uint64_t);
-
-        if (size >= MAX_FILE_SIZE) {
-            write_to_disk(level + 1, data);
-            data.clear();
-            size = 0U;
+    std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+    if (!written) {
+        // keep the inputs, the outputs would overlap them
+        for (auto &[outputFilename, outputTable]: outputs) {
+            if (outputTable != nullptr) {
+                index.erase(level + 1, outputFilename);
+                filter.erase(level + 1, outputFilename);
+                disk.remove(level + 1, outputFilename, *outputTable);
+            }
         }
+        return;
     }
-    if (!data.empty()) {
-        write_to_disk(level + 1, data);
+    // delete merged files, readers may still be searching them until the lock is taken
+    for (auto &[mergedLevel, mergedFilename, mergedTable]: toMerge) {
+        index.erase(mergedLevel, mergedFilename);
+        filter.erase(mergedLevel, mergedFilename);
+        disk.remove(mergedLevel, mergedFilename, *mergedTable);
     }
+    lock.unlock();
 
-    // delete merged files
-    for (auto &node: toMerge) {
-        (void) index.get_level(node.level_).erase(node.filename_);
-        fs::path path = dir_;
-        path /= std::to_string(node.level_);
-        path /= std::to_string(node.filename_);
-        (void) fs::remove(path);
+    if (index.get_level(level + 1).size() > maxFileNums[level + 1]) {
+        compact(level + 1);
     }
 }
 
-bool KVStore::inRange(uint64_t lower, uint64_t upper, const Range &range) {
-    return std::any_of(range.begin(), range.end(), [&](const std::pair<uint64_t, uint64_t> &p) {
-        return lower <= p.second && upper >= p.first;
-    });
-}
-
-void KVStore::wal(const std::string &method, uint64_t key, const std::string &value) {
-    std::string walname = "wal";
-    std::ofstream file;
-    fs::path path = dir_;
-    if (!fs::exists(path)) {
-        (void) fs::create_directories(path);
+bool KVStore::wal(WalRecordType type, uint64_t key, std::string_view value) {
+    std::string record;
+    record.reserve(WAL_HEADER_SIZE + value.size());
+    // the segment is switched only with the lock held alone
+    encode_wal_record(record, wal_writer_.get_seq(), type, key, value);
+    // written together with the records of concurrent writers
+    if (wal_writer_.append(record)) {
+        return true;
     }
-    path /= walname;
-    file.open(path, std::ios::out | std::ios::binary | std::ios::app); // append to the end of log
-
-    (void) file.write(method.c_str(), method.size()); // method
-    (void) file.write("\0", sizeof(char));
-
-    (void) file.write((char *) (&key), sizeof(uint64_t)); // key
-
-    uint64_t length = value.size();
-    (void) file.write((char *) (&length), sizeof(uint64_t)); // length of value
-
-    (void) file.write(value.c_str(), value.size()); // value
-    (void) file.write("\0", sizeof(char));
-
-    (void) file.flush();
-    file.close();
+    // nor can the records after it, a segment holds no gap
+    writable_.store(false, std::memory_order_release);
+    return false;
 }
 
 void KVStore::recover_memtable() {
-    if (!fs::exists(dir_)) {
-        return;
-    }
-    std::vector<std::tuple<std::string, uint64_t, std::string>> ops; // method + key + value
-    std::string immwalname = "immwal";
-    fs::path immwalpath = dir_;
-    immwalpath /= immwalname;
-    if (fs::exists(immwalpath)) {
-        std::ifstream immwal(immwalpath, std::ios::in | std::ios::binary);
-        while (immwal) {
-            std::string method;
-            uint64_t key;
-            uint64_t length;
-            std::string value;
-            // recover method
-            std::getline(immwal, method, '\0');
-            if (method.empty()) {
-                break;
-            }
-            // recover key
-            (void) immwal.read(reinterpret_cast<char *> (&key), sizeof(uint64_t));
-            // recover length of value
-            (void) immwal.read(reinterpret_cast<char *> (&length), sizeof(uint64_t));
-            // recover value
-            (void) std::getline(immwal, value, '\0');
-            ops.emplace_back(method, key, value);
+    // the flushes queued below release their segments with the lock
+    std::unique_lock<std::shared_mutex> lock(memtable_mutex_);
+    std::vector<std::pair<uint64_t, std::string>> live;
+    for (auto &entry: fs::directory_iterator(dir_)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("wal.", 0U) != 0U) {
+            continue;
+        }
+        last_wal_file_ = std::max<uint64_t>(last_wal_file_, std::stoull(name.substr(4U)));
+        WalReader reader(entry.path().string());
+        // released segments count too, the records left in them must not match a later segment
+        last_wal_seq_ = std::max(last_wal_seq_, reader.get_seq());
+        if (reader.is_live()) {
+            (void) live.emplace_back(reader.get_seq(), entry.path().string());
+        } else {
+            recycle_wal(entry.path().string());
         }
     }
-    std::string walname = "wal";
-    fs::path walpath = dir_;
-    walpath /= walname;
-    if (fs::exists(walpath)) {
-        std::ifstream wal(walpath, std::ios::in | std::ios::binary);
-        while (wal) {
-            std::string method;
-            uint64_t key;
-            uint64_t length;
-            std::string value;
-            // recover method
-            std::getline(wal, method, '\0');
-            if (method.empty()) {
-                break;
+    // from the oldest to the newest, as they were written
+    std::sort(live.begin(), live.end());
+    for (auto &[seq, path]: live) {
+        std::shared_ptr<MemTable> imm = MemTable::create(options_.memtable_kind);
+        replay(path, *imm);
+        if (imm->getSize() == 0U) {
+            // as after a flush, the store stops writing once a segment cannot be released
+            if (!release_wal_segment(path)) {
+                writable_.store(false, std::memory_order_release);
+                continue;
             }
-            // recover key
-            (void) wal.read(reinterpret_cast<char *> (&key), sizeof(uint64_t));
-            // recover length of value
-            (void) wal.read(reinterpret_cast<char *> (&length), sizeof(uint64_t));
-            // recover value
-            (void) std::getline(wal, value, '\0');
-            ops.emplace_back(method, key, value);
+            recycle_wal(path);
+            continue;
         }
+        // flushed as it would have been, its segment is released once its sstable is written.
+        // The mutable memtable starts on a new segment rather than after the records of the last one,
+        // which could be followed by records of the same segment behind a torn one
+        queue_flush(std::move(imm), path);
     }
-    for (auto &op: ops) {
-        auto [method, key, value] = op;
-        if (method == "put") {
-            put(key, value);
-        } else if (method == "del") {
-            del(key);
+    open_wal();
+}
+
+void KVStore::replay(const std::string &path, MemTable &table) {
+    WalReader reader(path);
+    WalRecordType type;
+    uint64_t key = 0U;
+    std::string_view value;
+    while (reader.next(type, key, value)) {
+        if (type == WalRecordType::PUT) {
+            table.put(key, value);
+        } else {
+            // a tombstone hides the key in older memtables and sstables, whether it is there or not
+            (void) table.del(key, false, true, false);
         }
     }
 }
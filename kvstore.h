@@ -3,28 +3,112 @@
 #include "disk.h"
 #include "index.h"
 #include "kvstore_api.h"
+#include "memtable.h"
 #include "skiplist.h"
 #include "filter.h"
+#include "options.h"
+#include "pinnable.h"
+#include "wal.h"
+#include <array>
+#include <atomic>
+#include <deque>
 #include <future>
+#include <mutex>
+#include <shared_mutex>
 
 class KVStore : public KVStoreAPI {
 private:
     const std::string dir_;
-    SkipList memtable;
-    SkipList imm_memtable;
+    const Options options_;
+    std::unique_ptr<MemTable> memtable;
+
+    // a full memtable, searched until its sstable is installed
+    struct Immutable {
+        std::shared_ptr<MemTable> memtable_;
+        std::shared_future<void> flushed_;
+    };
+
+    // from the newest to the oldest, each one is flushed after the older ones
+    std::deque<Immutable> imm_memtables;
     Index index;
     Disk disk;
     Filter filter;
-    std::future<void> flush = std::async(std::launch::async, []() { return; });
+    // the last flush queued
+    std::shared_future<void> flush = std::async(std::launch::async, []() { return; });
+    // writers share it to insert into the memtable and take it alone to switch the memtable,
+    // flushes and compactions take it alone to install and remove sstables
+    mutable std::shared_mutex memtable_mutex_;
+    // the wal of the memtable, switched with it
+    WalWriter wal_writer_;
+    // false once a wal record or a memtable cannot be written, or a wal segment cannot be released.
+    // The store then refuses writes: the memtables not flushed stay queued and searched, in order,
+    // and their wal segments are replayed by the next start
+    std::atomic<bool> writable_{true};
+
+    // the writers of a key append to the wal and insert into the memtable in one step, so that the wal
+    // replays the writes of a key in the order the memtable applied them
+    static const size_t NR_KEY_MUTEXES = 64U;
+    std::array<std::mutex, NR_KEY_MUTEXES> key_mutexes_;
+
+    std::mutex &key_mutex(uint64_t key) { return key_mutexes_[BloomFilter::hash(key) % NR_KEY_MUTEXES]; }
 
     const uint64_t MAX_MEMTABLE_SIZE = 2U * 1024U * 1024U; // 2MB
 
+    // the arena also holds overwritten and deleted values, flush before it grows too large
+    const uint64_t MAX_MEMTABLE_MEMORY = 8U * 1024U * 1024U; // 8MB
+
     uint64_t maxFileNums[maxLevel]{};
 
     const uint64_t MAX_FILE_SIZE = 2U * 1024U * 1024U; // 2MB
 
+    uint64_t lastFilename = 0U;
+
+    // the wal segments are the files wal.<number>, their headers hold the sequence numbers they are replayed by
+    uint64_t last_wal_file_ = 0U;
+    uint64_t last_wal_seq_ = 0U;
+    // the segment of the mutable memtable
+    std::string wal_path_;
+    // released segments, reused before new ones are created
+    std::vector<std::string> free_wals_;
+
+    // search sstables top-down, from the latest file to the oldest one
+    bool get_from_disk(uint64_t key, PinnableValue &value, bool &deleted) const;
+
+    // h is BloomFilter::hash() of the key
+    bool get_from_table(uint64_t key, uint64_t h, int level, uint64_t filename, const IndexTable &table,
+                        PinnableValue &value, bool &deleted) const;
+
+    uint64_t new_filename();
+
+    [[nodiscard]] bool memtable_full() const;
+
+    // queue the full memtable for a background flush, waits while max_immutable_memtables are queued
+    void switch_memtable();
+
+    // flush the immutable memtable after those queued before it, with the lock held
+    void queue_flush(std::shared_ptr<MemTable> imm, const std::string &walpath);
+
+    // start a wal segment for the mutable memtable, with the lock held
+    void open_wal();
+
+    // keep the released segment for reuse, or remove it once enough are kept; with the lock held
+    void recycle_wal(const std::string &walpath);
+
+    // write the immutable memtable to level 0 once the previous flush is done, then drop it and its wal.
+    // If it cannot be written, it stays the oldest one queued and the store stops accepting writes.
+    // Taken by value, so that the task does not keep them alive once it is done
+    void flush_memtable(std::shared_ptr<MemTable> imm, std::string walpath, std::shared_future<void> previous);
+
+    const uint32_t MAX_BLOOM_BITS_PER_KEY = 32U;
+
+    // bits per key of the bloom filter of a new table in the level
+    [[nodiscard]] uint32_t bloom_bits_per_key(int level) const;
+
+    // finish an sstable and make it visible to the index and the filter, nullptr if it cannot be written
+    std::shared_ptr<IndexTable> install(int level, uint64_t filename, TableBuilder &builder);
+
 public:
-    explicit KVStore(const std::string &dir);
+    explicit KVStore(const std::string &dir, const Options &options = Options());
 
     ~KVStore();
 
@@ -32,6 +116,8 @@ public:
 
     [[nodiscard]] std::string get(uint64_t key) const override;
 
+    bool get(uint64_t key, PinnableValue &value) const;
+
     void
     scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_t, std::string>> &result) const override;
 
@@ -41,13 +127,26 @@ public:
 
     void print() const;
 
-    void write_to_disk(int level, const Data &data);
+    [[nodiscard]] uint64_t get_cache_hits() const { return disk.get_cache_hits(); }
 
-    void compact(int level);
+    [[nodiscard]] uint64_t get_cache_misses() const { return disk.get_cache_misses(); }
+
+    // false once a write cannot be made durable, put and del are then ignored until reset
+    [[nodiscard]] bool is_writable() const { return writable_.load(std::memory_order_acquire); }
 
-    bool inRange(uint64_t lower, uint64_t upper, const Range &range);
+    // stream the entries of the iterator into a new table of the level, the caller compacts the level if needed.
+    // Returns false if the table cannot be written
+    bool write_to_disk(int level, Iterator &iter);
 
-    void wal(const std::string &method, uint64_t key, const std::string &value);
+    void compact(int level);
 
+    // false if the record cannot be written, or synced as the policy asks; the store then refuses writes
+    bool wal(WalRecordType type, uint64_t key, std::string_view value);
+
+    // replay the live wal segments into memtables queued for flush, without logging the records again,
+    // then open a segment for the mutable memtable
     void recover_memtable();
+
+    // insert the records of the wal segment into the memtable
+    static void replay(const std::string &path, MemTable &table);
 };
@@ -0,0 +1,129 @@
+#include "memtable.h"
+#include "art.h"
+#include "hashlist.h"
+#include "skiplist.h"
+
+#include <cstring>
+#include <iostream>
+#include <new>
+
+const MemTable::Record MemTable::TOMBSTONE{std::string_view(), true};
+
+MemTable::MemTable() : arena(std::make_shared<Arena>()), size(0U) {}
+
+MemTable::~MemTable() = default;
+
+std::unique_ptr<MemTable> MemTable::create(MemTableKind kind) {
+    switch (kind) {
+        case MemTableKind::HASH_LINKLIST:
+            return std::make_unique<HashLinkList>();
+        case MemTableKind::ART:
+            return std::make_unique<AdaptiveRadixTree>();
+        case MemTableKind::SKIPLIST:
+        default:
+            return std::make_unique<SkipList>();
+    }
+}
+
+const MemTable::Record *MemTable::new_record(std::string_view s, bool deleted) {
+    // the value is stored right after its record
+    char *memory = arena->allocate(sizeof(Record) + s.size());
+    (void) std::memcpy(memory + sizeof(Record), s.data(), s.size());
+    return new(memory) Record{std::string_view(memory + sizeof(Record), s.size()), deleted};
+}
+
+void MemTable::put(uint64_t key, std::string_view s) {
+    const Record *record = new_record(s, false);
+    bool inserted = false;
+    Slot *slot = insert(key, record, inserted);
+    if (inserted) {
+        size += sizeof(uint64_t) + s.length() + sizeof(uint64_t) + sizeof(uint64_t); // key + value + key + offset
+        return;
+    }
+    // if key already exists
+    const Record *old = slot->exchange(record, std::memory_order_acq_rel);
+    size += s.length() - old->value_.length();
+}
+
+std::string MemTable::get(uint64_t key, bool &deleted, bool &found) const {
+    Slot *slot = find(key);
+    // key not found
+    if (slot == nullptr) {
+        deleted = false;
+        found = false;
+        return {};
+    }
+    const Record *record = slot->load(std::memory_order_acquire);
+    deleted = record->deleted_;
+    found = true;
+    return deleted ? std::string() : std::string(record->value_);
+}
+
+bool MemTable::get(uint64_t key, PinnableValue &value, bool &deleted) const {
+    Slot *slot = find(key);
+    // key not found
+    if (slot == nullptr) {
+        deleted = false;
+        return false;
+    }
+    const Record *record = slot->load(std::memory_order_acquire);
+    deleted = record->deleted_;
+    if (deleted) {
+        value.reset();
+    } else {
+        // the arena keeps the value alive after the table is reset
+        value.pin(record->value_, arena);
+    }
+    return true;
+}
+
+void MemTable::scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_t, std::string>> &result) const {
+    std::unique_ptr<::Iterator> iter = iterator();
+    for (iter->seek(lower); iter->valid() && iter->key() <= upper; iter->next()) {
+        if (!iter->is_deleted()) {
+            (void) result.emplace_back(iter->key(), std::string(iter->value()));
+        }
+    }
+}
+
+bool MemTable::del(uint64_t key, bool in_index, bool in_immutable, bool not_in_immutable) {
+    Slot *slot = find(key);
+    // key not in memtable
+    if (slot == nullptr) {
+        // if key in immutable memtable or in disk only, insert a tombstone
+        if (!in_immutable && !(not_in_immutable && in_index)) {
+            return false;
+        }
+        bool inserted = false;
+        slot = insert(key, &TOMBSTONE, inserted);
+        if (inserted) {
+            size += sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t); // key + value(empty) + key + offset
+            return true;
+        }
+    }
+    // key in memtable, keys are never removed, so the tombstone replaces the value
+    const Record *old = slot->load(std::memory_order_acquire);
+    do {
+        // if key marked as deleted in memtable
+        if (old->deleted_) {
+            return false;
+        }
+    } while (!slot->compare_exchange_strong(old, &TOMBSTONE, std::memory_order_acq_rel));
+    size -= old->value_.length();
+    return true;
+}
+
+void MemTable::reset() {
+    // free every record at once, pinned values and iterators keep the old arena alive
+    arena = std::make_shared<Arena>();
+    size = 0U;
+}
+
+void MemTable::print() const {
+    std::cout << "-------------------------------------------\n";
+    std::unique_ptr<::Iterator> iter = iterator();
+    for (iter->seek(0U); iter->valid(); iter->next()) {
+        std::cout << iter->key() << (iter->is_deleted() ? "(deleted)" : "") << '\n';
+    }
+    std::cout << "-------------------------------------------\n";
+}
@@ -0,0 +1,94 @@
+/**
+ * The in-memory table of a KVStore. Implementations only differ in how they index keys:
+ * values, tombstones and the sizing of the table are shared, and live in an arena freed all at once.
+ */
+
+#pragma once
+
+#include "arena.h"
+#include "iterator.h"
+#include "pinnable.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+enum class MemTableKind : uint8_t {
+    // ordered, lock-free writers, the default
+    SKIPLIST = 0U,
+    // hash buckets of sorted lists, fastest point lookups, scans sort the keys
+    HASH_LINKLIST = 1U,
+    // adaptive radix tree over the 8 bytes of the keys, ordered and compact
+    ART = 2U,
+};
+
+class MemTable {
+public:
+    MemTable();
+
+    MemTable(const MemTable &) = delete;
+
+    MemTable &operator=(const MemTable &) = delete;
+
+    virtual ~MemTable();
+
+    static std::unique_ptr<MemTable> create(MemTableKind kind);
+
+    // safe to call from many threads at once, as are the readers below
+    void put(uint64_t key, std::string_view s);
+
+    std::string get(uint64_t key, bool &deleted, bool &found) const;
+
+    // returns whether the key is found, the value is pinned rather than copied
+    bool get(uint64_t key, PinnableValue &value, bool &deleted) const;
+
+    void scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_t, std::string>> &result) const;
+
+    bool del(uint64_t key, bool in_index, bool in_immutable, bool not_in_immutable);
+
+    // not safe against concurrent writers
+    virtual void reset();
+
+    virtual void print() const;
+
+    [[nodiscard]] uint64_t getSize() const { return size; }
+
+    // bytes held by the arena, including the values replaced or deleted since the last reset
+    [[nodiscard]] size_t get_memory_usage() const { return arena->get_memory_usage(); }
+
+    // iterators keep the arena alive, the values they return stay valid as long as the iterator
+    [[nodiscard]] virtual std::unique_ptr<::Iterator> iterator() const = 0;
+
+protected:
+    // the value of a key and whether it is deleted, replaced as a whole by an update
+    struct Record {
+        std::string_view value_;
+        bool deleted_;
+    };
+
+    // where an index keeps the record of a key, records are replaced rather than modified,
+    // so that pinned readers keep the old one
+    typedef std::atomic<const Record *> Slot;
+
+    static const Record TOMBSTONE;
+
+    std::shared_ptr<Arena> arena;
+
+    // the slot of the key, nullptr if it is not in the table
+    [[nodiscard]] virtual Slot *find(uint64_t key) const = 0;
+
+    /**
+     * Add a slot holding the record, unless the key is already in the table.
+     * Returns the slot of the key, inserted tells which one it is.
+     */
+    virtual Slot *insert(uint64_t key, const Record *record, bool &inserted) = 0;
+
+private:
+    std::atomic<uint64_t> size;
+
+    const Record *new_record(std::string_view s, bool deleted);
+};
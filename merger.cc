@@ -0,0 +1,67 @@
+#include "merger.h"
+
+#include <algorithm>
+
+MergingIterator::MergingIterator(std::vector<std::unique_ptr<Iterator>> children)
+        : children_(std::move(children)) {
+    heap_.reserve(children_.size());
+}
+
+MergingIterator::~MergingIterator() = default;
+
+bool MergingIterator::valid() const {
+    return !heap_.empty();
+}
+
+void MergingIterator::seek(uint64_t target) {
+    heap_.clear();
+    for (size_t i = 0U; i < children_.size(); ++i) {
+        children_[i]->seek(target);
+        if (children_[i]->valid()) {
+            push(i);
+        }
+    }
+}
+
+void MergingIterator::next() {
+    uint64_t current = key();
+    // advance every child positioned at the current key, so that older versions are skipped
+    while (!heap_.empty() && children_[heap_.front()]->key() == current) {
+        size_t i = pop();
+        children_[i]->next();
+        if (children_[i]->valid()) {
+            push(i);
+        }
+    }
+}
+
+uint64_t MergingIterator::key() const {
+    return children_[heap_.front()]->key();
+}
+
+std::string_view MergingIterator::value() const {
+    return children_[heap_.front()]->value();
+}
+
+bool MergingIterator::is_deleted() const {
+    return children_[heap_.front()]->is_deleted();
+}
+
+bool MergingIterator::greater(size_t a, size_t b) const {
+    uint64_t key_a = children_[a]->key();
+    uint64_t key_b = children_[b]->key();
+    // on equal keys the newer child (smaller index) comes first
+    return key_a > key_b || (key_a == key_b && a > b);
+}
+
+void MergingIterator::push(size_t i) {
+    heap_.push_back(i);
+    std::push_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return greater(a, b); });
+}
+
+size_t MergingIterator::pop() {
+    std::pop_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return greater(a, b); });
+    size_t i = heap_.back();
+    heap_.pop_back();
+    return i;
+}
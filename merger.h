@@ -0,0 +1,42 @@
+#pragma once
+
+#include "iterator.h"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Merges several sorted iterators into one sorted stream.
+ * Children are ordered from the newest to the oldest. If a key appears in more than one child,
+ * only the entry of the newest child is visible, including tombstones.
+ */
+class MergingIterator : public Iterator {
+public:
+    explicit MergingIterator(std::vector<std::unique_ptr<Iterator>> children);
+
+    ~MergingIterator() override;
+
+    [[nodiscard]] bool valid() const override;
+
+    void seek(uint64_t target) override;
+
+    void next() override;
+
+    [[nodiscard]] uint64_t key() const override;
+
+    [[nodiscard]] std::string_view value() const override;
+
+    [[nodiscard]] bool is_deleted() const override;
+
+private:
+    std::vector<std::unique_ptr<Iterator>> children_;
+
+    // min-heap of child indices ordered by (key, index)
+    std::vector<size_t> heap_;
+
+    bool greater(size_t a, size_t b) const;
+
+    void push(size_t i);
+
+    size_t pop();
+};
@@ -0,0 +1,54 @@
+/**
+ * Tunable parameters of a KVStore
+ */
+
+#pragma once
+
+#include "bloom.h"
+#include "memtable.h"
+#include "wal.h"
+
+#include <cstddef>
+#include <cstdint>
+
+struct Options {
+    // capacity of the block cache in bytes, 0 disables the cache
+    size_t block_cache_capacity = 8U * 1024U * 1024U; // 8MB
+
+    // keep the data blocks of level 0 in the block cache until their sstable is deleted
+    bool pin_l0_blocks = false;
+
+    // map sstables into memory and serve reads from the mapping instead of pread
+    bool use_mmap = false;
+
+    // bits of bloom filter per key of an sstable, 10 gives a false positive rate of about 1%
+    uint32_t bloom_bits_per_key = 10U;
+
+    // bytes of bloom filters for the whole store, split across levels so that shallow levels, which are probed
+    // more often, get more bits per key than deep ones; 0 gives every level bloom_bits_per_key
+    size_t bloom_memory_budget = 0U;
+
+    // build a range filter over key >> range_filter_shift for every new sstable, so that a short scan skips
+    // the tables holding no key of its range; 0 builds no range filter
+    uint32_t range_filter_shift = 0U;
+
+    // bits of the range filter per prefix of an sstable. Scans probe every level alike, so the range filters
+    // keep this size at every level and are not part of bloom_memory_budget
+    uint32_t range_filter_bits_per_prefix = 10U;
+
+    // layout of the bloom filters of new sstables, existing ones keep the layout they were written with
+    BloomKind bloom_kind = BloomKind::STANDARD;
+
+    // full memtables kept in memory while they are flushed in the background, writers stall only once
+    // this many wait for their flush; at least 1
+    size_t max_immutable_memtables = 2U;
+
+    // index of the memtables, see MemTableKind
+    MemTableKind memtable_kind = MemTableKind::SKIPLIST;
+
+    // when the records of the wal are synced to disk, see WalSync
+    WalSync wal_sync = WalSync::NONE;
+
+    // period of the syncs of WalSync::INTERVAL
+    uint32_t wal_sync_interval_ms = 100U;
+};
@@ -0,0 +1,39 @@
+/**
+ * A value returned without copying. It points into a memtable value or a cached data block,
+ * and keeps that memory alive until it is reset or destroyed.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+class PinnableValue {
+public:
+    PinnableValue() = default;
+
+    [[nodiscard]] std::string_view get() const { return data_; }
+
+    [[nodiscard]] bool empty() const { return data_.empty(); }
+
+    [[nodiscard]] size_t size() const { return data_.size(); }
+
+    [[nodiscard]] std::string to_string() const { return std::string(data_); }
+
+    // refer to data, owned by owner
+    void pin(std::string_view data, std::shared_ptr<const void> owner) {
+        data_ = data;
+        owner_ = std::move(owner);
+    }
+
+    void reset() {
+        data_ = {};
+        owner_ = nullptr;
+    }
+
+private:
+    std::string_view data_;
+    std::shared_ptr<const void> owner_;
+};
@@ -0,0 +1,26 @@
+/**
+ * Search over packed, sorted key arrays
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Index of the first key >= target, n if there is none.
+ * The loop has no data-dependent branch: the compiler turns the select into a conditional move,
+ * so a lookup costs log2(n) dependent loads and no branch mispredictions.
+ */
+inline size_t branchless_lower_bound(const uint64_t *keys, size_t n, uint64_t target) {
+    if (n == 0U) {
+        return 0U;
+    }
+    const uint64_t *base = keys;
+    while (n > 1U) {
+        size_t half = n / 2U;
+        base = base[half] < target ? base + half : base;
+        n -= half;
+    }
+    return static_cast<size_t>(base - keys) + (*base < target ? 1U : 0U);
+}
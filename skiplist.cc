@@ -1,181 +1,103 @@
 #include "skiplist.h"
+#include <algorithm>
 #include <climits>
 #include <iostream>
+#include <new>
 #include <random>
 
 SkipList::SkipList() {
-    head = std::make_shared<Node>(ULLONG_MAX, std::string(), maxLevel);
-    level = 0;
-    size = 0U;
+    reset();
 }
 
-SkipList::~SkipList() { reset(); }
+SkipList::~SkipList() = default;
 
 int SkipList::getRandomLevel() {
-    std::random_device seed;
-    std::ranlux48 engine(seed());
-    std::uniform_int_distribution<unsigned> distribution(0U, UINT32_MAX);
-    int level = 0;
-    while (distribution(engine) % 2U == 1U && level < maxLevel) {
-        ++level;
-    }
-    return level;
+    // xorshift64*, seeded once per thread
+    thread_local uint64_t state = (static_cast<uint64_t>(std::random_device()()) << 32U) | 1U;
+    state ^= state >> 12U;
+    state ^= state << 25U;
+    state ^= state >> 27U;
+    const uint64_t random = state * 0x2545f4914f6cdd1dULL;
+    // every trailing one bit raises the level, with probability 1/2
+    if (random == UINT64_MAX) {
+        return maxLevel;
+    }
+    return std::min(__builtin_ctzll(~random), maxLevel);
 }
 
-void SkipList::put(uint64_t key, const std::string &s) {
-    std::shared_ptr<Node> current = head;
-    std::shared_ptr<Node> update[maxLevel + 1];
-
-    for (int i = level; i >= 0; --i) {
-        while (current->get_forward(i) != nullptr && current->get_forward(i)->get_key() < key) {
-            current = current->get_forward(i);
+SkipList::Node *SkipList::find_greater_or_equal(uint64_t key, Node **prev) const {
+    const int top = level.load(std::memory_order_relaxed);
+    Node *current = head;
+    for (int i = maxLevel; i >= 0; --i) {
+        if (i <= top) {
+            Node *next = current->get_forward(i);
+            while (next != nullptr && next->get_key() < key) {
+                current = next;
+                next = current->get_forward(i);
+            }
         }
-        update[i] = current;
-    }
-    current = current->get_forward(0U);
-    // if key already exists
-    if (current != nullptr && current->get_key() == key) {
-        if (current->is_deleted()) {
-            current->set_deleted(false);
+        if (prev != nullptr) {
+            prev[i] = current;
         }
-        size += s.length() - (current->get_value()).length();
-        current->set_value(s);
-        return;
     }
-    // if key doesn't exist, insert a new node
-    int randomLevel = getRandomLevel();
-    auto node = std::make_shared<Node>(key, s, randomLevel);
+    return current->get_forward(0U);
+}
 
-    if (randomLevel > level) {
-        for (int i = level + 1; i <= randomLevel; ++i) {
-            update[i] = head;
-        }
-        level = randomLevel;
+SkipList::Slot *SkipList::insert(uint64_t key, const Record *record, bool &inserted) {
+    Node *prev[maxLevel + 1];
+    Node *next = find_greater_or_equal(key, prev);
+    if (next != nullptr && next->get_key() == key) {
+        inserted = false;
+        return next->get_slot();
     }
+    const int randomLevel = getRandomLevel();
+    char *memory = arena->allocate(sizeof(Node) + randomLevel * sizeof(std::atomic<Node *>));
+    Node *node = new(memory) Node(key, record, randomLevel);
 
+    // link bottom-up, the node is in the list once it is linked on level 0
     for (int i = 0; i <= randomLevel; ++i) {
-        node->set_forward(i, update[i]->get_forward(i));
-        update[i]->set_forward(i, node);
-    }
-
-    size += sizeof(uint64_t) + s.length() + sizeof(uint64_t) + sizeof(uint64_t); // key + value + key + offset
-}
-
-std::string SkipList::get(uint64_t key, bool &deleted, bool &found) const {
-    std::shared_ptr<Node> current = head;
-    for (int i = maxLevel - 1; i >= 0; --i) {
-        while (current->get_forward(i) != nullptr && current->get_forward(i)->get_key() < key) {
-            current = current->get_forward(i);
+        while (true) {
+            // other writers may have linked nodes after prev[i] since the search
+            next = prev[i]->get_forward(i);
+            while (next != nullptr && next->get_key() < key) {
+                prev[i] = next;
+                next = next->get_forward(i);
+            }
+            if (i == 0 && next != nullptr && next->get_key() == key) {
+                // another writer inserted the key first, the new node stays unused in the arena
+                inserted = false;
+                return next->get_slot();
+            }
+            node->set_forward(i, next);
+            if (prev[i]->cas_forward(i, next, node)) {
+                break;
+            }
         }
     }
-    current = current->get_forward(0U);
-    if (current != nullptr && current->get_key() == key && !(current->is_deleted())) {
-        deleted = false;
-        found = true;
-        return current->get_value();
-    }
-    // key not found
-    if (current == nullptr || current->get_key() != key) {
-        deleted = false;
-        found = false;
-        return {};
-    }
-    // key deleted
-    deleted = true;
-    found = true;
-    return {};
-}
 
-void SkipList::scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_t, std::string>> &result) const {
-    std::shared_ptr<Node> current = head;
-    for (int i = maxLevel - 1; i >= 0; --i) {
-        while (current->get_forward(i) != nullptr && current->get_forward(i)->get_key() < lower) {
-            current = current->get_forward(i);
-        }
-    }
-    current = current->get_forward(0U);
-    while (current != nullptr && current->get_key() <= upper) {
-        if (!(current->is_deleted())) {
-            (void) result.emplace_back(current->get_key(), current->get_value());
-        }
-        current = current->get_forward(0U);
+    int top = level.load(std::memory_order_relaxed);
+    while (randomLevel > top && !level.compare_exchange_weak(top, randomLevel, std::memory_order_relaxed)) {
     }
+    inserted = true;
+    return node->get_slot();
 }
 
-bool SkipList::del(uint64_t key, bool in_index, bool in_immutable, bool not_in_immutable) {
-    std::shared_ptr<Node> current = head;
-    std::shared_ptr<Node> update[maxLevel + 1];
-
-    for (int i = level; i >= 0; --i) {
-        while (current->get_forward(i) != nullptr && current->get_forward(i)->get_key() < key) {
-            current = current->get_forward(i);
-        }
-        update[i] = current;
-    }
-    current = current->get_forward(0U);
-
-    // if key in memtable
-    if (current != nullptr && current->get_key() == key) {
-        // if key marked as deleted in memtable
-        if (current->is_deleted()) {
-            return false;
-        }
-        // if key not deleted
-        for (int i = 0; i <= current->get_level() && update[i]->get_forward(i) == current; ++i) {
-            update[i]->set_forward(i, current->get_forward(i));
-        }
-        while (level > 0 && head->get_forward(level) == nullptr) {
-            --level;
-        }
-        size -= sizeof(key) * 2U + (current->get_value()).length() + 4U;
-        return true;
-    }
-    // key not in memtable
-    // if key in immutable memtable or in disk only, insert new node
-    if (in_immutable || (not_in_immutable && in_index)) {
-        int randomLevel = getRandomLevel();
-        std::shared_ptr<Node> node = std::make_shared<Node>(key, "", randomLevel, true);
-
-        if (randomLevel > level) {
-            for (int i = level + 1; i <= randomLevel; ++i) {
-                update[i] = head;
-            }
-            level = randomLevel;
-        }
-
-        for (int i = 0; i <= randomLevel; ++i) {
-            node->set_forward(i, update[i]->get_forward(i));
-            update[i]->set_forward(i, node);
-        }
-
-        size += sizeof(uint64_t) + sizeof(uint64_t) + sizeof(uint64_t); // key + value(empty) + key + offset
-        return true;
-    }
-    return false;
+SkipList::Slot *SkipList::find(uint64_t key) const {
+    Node *current = find_greater_or_equal(key, nullptr);
+    return current != nullptr && current->get_key() == key ? current->get_slot() : nullptr;
 }
 
 void SkipList::reset() {
-    if (head != nullptr) {
-        std::shared_ptr<Node> current = head->get_forward(0);
-        for (int i = 0; i < maxLevel; i++) {
-            head->set_forward(i, nullptr);
-        }
-        while (current != nullptr) {
-            std::shared_ptr<Node> next = current->get_forward(0);
-            for (int i = 0; i < current->get_level(); i++) {
-                current->set_forward(i, nullptr);
-            }
-            current = next;
-        }
-    }
-    head = std::make_shared<Node>(ULLONG_MAX, std::string(), maxLevel);
+    // free every node at once, pinned values and iterators keep the old arena alive
+    MemTable::reset();
+    char *memory = arena->allocate(sizeof(Node) + maxLevel * sizeof(std::atomic<Node *>));
+    head = new(memory) Node(ULLONG_MAX, &TOMBSTONE, maxLevel);
     level = 0;
-    size = 0U;
 }
 
 void SkipList::print() const {
     std::cout << "-------------------------------------------\n";
-    std::shared_ptr<Node> current = head;
+    Node *current = head;
     while (current != nullptr) {
         for (int j = 0; j <= current->get_level(); ++j) {
             std::cout << current->get_key() << "(";
@@ -192,14 +114,16 @@ void SkipList::print() const {
     std::cout << "-------------------------------------------\n";
 }
 
-uint64_t SkipList::getSize() const { return size; }
+std::unique_ptr<::Iterator> SkipList::iterator() const {
+    return std::make_unique<Iterator>(arena, head);
+}
 
-Data SkipList::traverse() const {
-    Data data;
-    std::shared_ptr<Node> current = head->get_forward(0U);
-    while (current != nullptr) {
-        (void) data.emplace_back(DataNode(current->get_key(), current->get_value(), current->is_deleted()));
-        current = current->get_forward(0U);
+void SkipList::Iterator::seek(uint64_t target) {
+    const Node *current = head_;
+    for (int i = maxLevel; i >= 0; --i) {
+        while (current->get_forward(i) != nullptr && current->get_forward(i)->get_key() < target) {
+            current = current->get_forward(i);
+        }
     }
-    return data;
+    current_ = current->get_forward(0U);
 }
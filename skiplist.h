@@ -1,78 +1,102 @@
 #pragma once
 
-#include "data.h"
+#include "memtable.h"
 
-#include <cstring>
-#include <string>
-#include <utility>
+#include <atomic>
 #include <memory>
-#include <vector>
+#include <new>
 
 constexpr int maxLevel = 20;
 
-class SkipList {
+/**
+ * A concurrent skiplist. Writers link nodes with compare-and-swap and retry on conflicts,
+ * readers only follow pointers and never wait. Nodes are never unlinked: a deleted key keeps its node
+ * with a tombstone, so a reader never sees a node freed under it.
+ */
+class SkipList : public MemTable {
+    /**
+     * Nodes live in the arena of the list, with their tower of forward pointers inline.
+     * They are never freed one by one, the whole arena goes away with the list.
+     */
     class Node {
     public:
-        Node(uint64_t key, std::string s, int level, bool deleted = false)
-                : key_(key), value_(std::move(s)), level_(level), deleted_(deleted) {
-            forward_ = std::vector<std::shared_ptr<Node >>(level_ + 1);
+        Node(uint64_t key, const Record *record, int level) : key_(key), record_(record), level_(level) {
+            for (int i = 0; i <= level_; ++i) {
+                new(&forward_[i]) std::atomic<Node *>(nullptr);
+            }
         }
 
-        ~Node() = default;
-
         [[nodiscard]] uint64_t get_key() const { return key_; }
 
-        [[nodiscard]] std::string get_value() const { return value_; }
-
-        void set_value(const std::string &s) { value_ = s; }
+        [[nodiscard]] Slot *get_slot() { return &record_; }
 
-        [[nodiscard]] std::shared_ptr<Node> get_forward(size_t i) const { return forward_[i]; }
+        [[nodiscard]] const Record *get_record() const { return record_.load(std::memory_order_acquire); }
 
-        void set_forward(size_t i, std::shared_ptr<Node> node) { forward_[i] = std::move(node); }
+        [[nodiscard]] Node *get_forward(size_t i) const { return forward_[i].load(std::memory_order_acquire); }
 
-        [[nodiscard]] int get_level() const { return level_; }
+        // only before the node is published
+        void set_forward(size_t i, Node *node) { forward_[i].store(node, std::memory_order_relaxed); }
 
-        [[nodiscard]] bool is_deleted() const { return deleted_; }
+        bool cas_forward(size_t i, Node *expected, Node *node) {
+            return forward_[i].compare_exchange_strong(expected, node, std::memory_order_acq_rel);
+        }
 
-        void set_deleted(bool deleted) { deleted_ = deleted; }
+        [[nodiscard]] int get_level() const { return level_; }
 
     private:
         uint64_t key_;
-        std::string value_;
-        std::vector<std::shared_ptr<Node>> forward_;
+        Slot record_;
         int level_;
-        bool deleted_;
+        // level_ + 1 pointers, allocated past the end of the node
+        std::atomic<Node *> forward_[1];
     };
 
-public:
-    SkipList();
+    class Iterator : public ::Iterator {
+    public:
+        Iterator(std::shared_ptr<const Arena> arena, const Node *head) : arena_(std::move(arena)), head_(head) {}
 
-    SkipList(SkipList &&) noexcept = default;
+        [[nodiscard]] bool valid() const override { return current_ != nullptr; }
 
-    SkipList &operator=(SkipList &&) noexcept = default;
+        void seek(uint64_t target) override;
 
-    ~SkipList();
+        void next() override { current_ = current_->get_forward(0U); }
 
-    void put(uint64_t key, const std::string &s);
+        [[nodiscard]] uint64_t key() const override { return current_->get_key(); }
 
-    std::string get(uint64_t key, bool &deleted, bool &found) const;
+        [[nodiscard]] std::string_view value() const override { return current_->get_record()->value_; }
 
-    void scan(uint64_t lower, uint64_t upper, std::vector<std::pair<uint64_t, std::string>> &result) const;
+        [[nodiscard]] bool is_deleted() const override { return current_->get_record()->deleted_; }
 
-    bool del(uint64_t key, bool in_index, bool in_immutable, bool not_in_immutable);
+    private:
+        // keeps the nodes alive
+        std::shared_ptr<const Arena> arena_;
+        const Node *head_;
+        const Node *current_{nullptr};
+    };
+
+public:
+    SkipList();
+
+    ~SkipList() override;
 
-    void reset();
+    void reset() override;
 
-    void print() const;
+    void print() const override;
 
-    [[nodiscard]] uint64_t getSize() const;
+    [[nodiscard]] std::unique_ptr<::Iterator> iterator() const override;
 
-    [[nodiscard]] Data traverse() const;
+protected:
+    [[nodiscard]] Slot *find(uint64_t key) const override;
+
+    Slot *insert(uint64_t key, const Record *record, bool &inserted) override;
 
 private:
-    std::shared_ptr<Node> head;
-    int level;
-    uint64_t size;
+    Node *head{nullptr};
+    // the highest level in use, searches start from there
+    std::atomic<int> level{0};
 
     static int getRandomLevel();
+
+    // the first node whose key >= key, and its predecessors on every level if prev is not nullptr
+    Node *find_greater_or_equal(uint64_t key, Node **prev) const;
 };
@@ -0,0 +1,238 @@
+#include "table.h"
+#include "coding.h"
+#include "search.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+TableBuilder::TableBuilder(const std::string &path, uint32_t bits_per_key, BloomKind kind, uint32_t range_shift,
+                           uint32_t range_bits_per_prefix)
+        : path_(path), fd_(::open(temp_path(path).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)),
+          ok_(fd_ >= 0), bits_per_key_(bits_per_key), kind_(kind), range_shift_(std::min(range_shift, 63U)),
+          range_bits_per_prefix_(range_bits_per_prefix) {
+    buffer_.reserve(WRITE_BUFFER_SIZE);
+}
+
+TableBuilder::~TableBuilder() {
+    if (fd_ >= 0) {
+        (void) ::close(fd_);
+        (void) ::unlink(temp_path(path_).c_str());
+    }
+}
+
+void TableBuilder::append(std::string_view data) {
+    (void) buffer_.append(data);
+    offset_ += data.size();
+    if (buffer_.size() >= WRITE_BUFFER_SIZE) {
+        write_buffer();
+    }
+}
+
+void TableBuilder::write_buffer() {
+    size_t done = 0U;
+    while (ok_ && done < buffer_.size()) {
+        ssize_t n = ::write(fd_, buffer_.data() + done, buffer_.size() - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ok_ = false;
+            break;
+        }
+        done += static_cast<size_t>(n);
+    }
+    buffer_.clear();
+}
+
+void TableBuilder::add(uint64_t key, std::string_view value, bool deleted) {
+    if (size_ == 0U) {
+        min_key_ = key;
+    }
+    max_key_ = key;
+    ++size_;
+
+    put_fixed64(block_, key);
+    (void) block_.append(1U, deleted ? '\1' : '\0');
+    put_fixed32(block_, static_cast<uint32_t>(value.size()));
+    (void) block_.append(value);
+
+    hashes_.push_back(BloomFilter::hash(key));
+    if (range_shift_ > 0U && (prefix_keys_.empty() || (prefix_keys_.back() >> range_shift_) != (key >> range_shift_))) {
+        prefix_keys_.push_back(key);
+    }
+
+    if (block_.size() >= BLOCK_SIZE) {
+        flush_block();
+    }
+}
+
+std::shared_ptr<IndexTable> TableBuilder::finish() {
+    flush_block();
+
+    filter_ = std::make_shared<BloomFilter>(hashes_.size(), bits_per_key_, kind_);
+    for (uint64_t h: hashes_) {
+        filter_->add_hash(h);
+    }
+    hashes_ = std::vector<uint64_t>();
+    std::string filter;
+    filter_->encode(filter);
+    if (range_shift_ > 0U) {
+        range_filter_ = std::make_shared<RangeFilter>(range_shift_, prefix_keys_.size(), range_bits_per_prefix_);
+        for (uint64_t key: prefix_keys_) {
+            range_filter_->add(key);
+        }
+        prefix_keys_ = std::vector<uint64_t>();
+        range_filter_->encode(filter);
+    }
+    uint64_t filter_offset = offset_;
+    append(filter);
+
+    std::string meta;
+    put_fixed64(meta, min_key_);
+    put_fixed64(meta, max_key_);
+    put_fixed64(meta, size_);
+    uint64_t meta_offset = offset_;
+    append(meta);
+
+    std::string index;
+    for (auto &node: nodes_) {
+        put_fixed64(index, node.get_key());
+        put_fixed64(index, node.get_offset());
+        put_fixed64(index, node.get_length());
+    }
+    uint64_t index_offset = offset_;
+    append(index);
+
+    std::string footer;
+    put_fixed64(footer, filter_offset);
+    put_fixed64(footer, filter.size());
+    put_fixed64(footer, meta_offset);
+    put_fixed64(footer, meta.size());
+    put_fixed64(footer, index_offset);
+    put_fixed64(footer, index.size());
+    put_fixed64(footer, TableReader::MAGIC);
+    append(footer);
+    write_buffer();
+
+    // the only sync of the table, the rename publishes it once its contents are durable
+    ok_ = ok_ && ::fdatasync(fd_) == 0;
+    ok_ = ::close(fd_) == 0 && ok_;
+    fd_ = -1;
+    if (!ok_ || ::rename(temp_path(path_).c_str(), path_.c_str()) != 0) {
+        (void) ::unlink(temp_path(path_).c_str());
+        return nullptr;
+    }
+    // and the directory entry of the new name
+    int dir = ::open(fs::path(path_).parent_path().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir >= 0) {
+        (void) ::fsync(dir);
+        (void) ::close(dir);
+    }
+
+    return std::make_shared<IndexTable>(min_key_, max_key_, size_, nodes_);
+}
+
+void TableBuilder::flush_block() {
+    if (block_.empty()) {
+        return;
+    }
+    (void) nodes_.emplace_back(max_key_, offset_, block_.size());
+    append(block_);
+    block_.clear();
+}
+
+std::shared_ptr<IndexTable> TableReader::open(const std::string &path, uint64_t &filter_offset, uint64_t &filter_length) {
+    std::ifstream file(path, std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file) {
+        return nullptr;
+    }
+    auto file_size = static_cast<uint64_t>(file.tellg());
+    if (file_size < FOOTER_SIZE) {
+        return nullptr;
+    }
+
+    char footer[FOOTER_SIZE];
+    (void) file.seekg(static_cast<std::streamoff>(file_size - FOOTER_SIZE));
+    (void) file.read(footer, FOOTER_SIZE);
+    filter_offset = get_fixed64(footer);
+    filter_length = get_fixed64(footer + 8U);
+    uint64_t meta_offset = get_fixed64(footer + 16U);
+    uint64_t meta_length = get_fixed64(footer + 24U);
+    uint64_t index_offset = get_fixed64(footer + 32U);
+    uint64_t index_length = get_fixed64(footer + 40U);
+    if (!file || get_fixed64(footer + 48U) != MAGIC || filter_offset + filter_length > meta_offset ||
+        meta_length != 3U * sizeof(uint64_t) || meta_offset + meta_length > index_offset ||
+        index_offset + index_length > file_size - FOOTER_SIZE) {
+        return nullptr;
+    }
+
+    // the meta block is followed by the index block, read them at once
+    std::string blocks(meta_length + index_length, '\0');
+    (void) file.seekg(static_cast<std::streamoff>(meta_offset));
+    (void) file.read(blocks.data(), static_cast<std::streamsize>(blocks.size()));
+    if (!file) {
+        return nullptr;
+    }
+
+    const char *meta = blocks.data();
+    uint64_t min_key = get_fixed64(meta);
+    uint64_t max_key = get_fixed64(meta + 8U);
+    uint64_t size = get_fixed64(meta + 16U);
+
+    std::vector<IndexNode> nodes;
+    const char *index = blocks.data() + meta_length;
+    for (uint64_t pos = 0U; pos + 3U * sizeof(uint64_t) <= index_length; pos += 3U * sizeof(uint64_t)) {
+        (void) nodes.emplace_back(get_fixed64(index + pos), get_fixed64(index + pos + 8U),
+                                  get_fixed64(index + pos + 16U));
+    }
+    return std::make_shared<IndexTable>(min_key, max_key, size, nodes);
+}
+
+Block::Block(std::string data) : buffer_(std::move(data)), data_(buffer_) {
+    decode();
+}
+
+Block::Block(std::string_view data, std::shared_ptr<const void> owner) : owner_(std::move(owner)), data_(data) {
+    decode();
+}
+
+void Block::decode() {
+    const char *p = data_.data();
+    uint64_t pos = 0U;
+    // key(8) | deleted(1) | value length(4) | value
+    const uint64_t header = sizeof(uint64_t) + 1U + sizeof(uint32_t);
+    while (pos + header <= data_.size()) {
+        uint64_t key = get_fixed64(p + pos);
+        bool deleted = p[pos + sizeof(uint64_t)] != '\0';
+        uint64_t length = get_fixed32(p + pos + sizeof(uint64_t) + 1U);
+        uint64_t offset = pos + header;
+        if (offset + length > data_.size()) {
+            break;
+        }
+        keys_.push_back(key);
+        offsets_.push_back(static_cast<uint32_t>(offset));
+        lengths_.push_back(static_cast<uint32_t>(length));
+        deleted_.push_back(deleted ? 1U : 0U);
+        pos = offset + length;
+    }
+}
+
+bool Block::get(uint64_t key, std::string_view &value, bool &deleted) const {
+    size_t i = lower_bound(key);
+    if (i == keys_.size() || keys_[i] != key) {
+        return false;
+    }
+    value = this->value(i);
+    deleted = deleted_[i] != 0U;
+    return true;
+}
+
+size_t Block::lower_bound(uint64_t target) const {
+    return branchless_lower_bound(keys_.data(), keys_.size(), target);
+}
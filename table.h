@@ -0,0 +1,156 @@
+/**
+ * On-disk layout of an sstable:
+ *
+ * [data block 1] ... [data block n] [filter block] [meta block] [index block] [footer]
+ *
+ * data block:   records sorted by key, each record is key(8) | deleted(1) | value length(4) | value
+ * filter block: m(8) | k(4) | kind(1) | bloom filter bits, optionally followed by a range filter:
+ *               shift(1) | m(8) | k(4) | kind(1) | prefix bloom filter bits
+ * meta block:   min key(8) | max key(8) | number of key-value pairs(8)
+ * index block:  last key(8) | offset(8) | length(8) of every data block
+ * footer:       filter offset(8) | filter length(8) | meta offset(8) | meta length(8) |
+ *               index offset(8) | index length(8) | magic(8)
+ *
+ * A table is written to <path>.tmp and renamed to <path> once it is synced, so that a crash never leaves
+ * a partial table under its name.
+ */
+
+#pragma once
+
+#include "bloom.h"
+#include "index.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class TableBuilder {
+public:
+    // a range_shift of 0 builds no range filter, which is sized by range_bits_per_prefix
+    // rather than by the bits per key of the bloom filter
+    TableBuilder(const std::string &path, uint32_t bits_per_key, BloomKind kind, uint32_t range_shift = 0U,
+                 uint32_t range_bits_per_prefix = 10U);
+
+    TableBuilder(const TableBuilder &) = delete;
+
+    TableBuilder &operator=(const TableBuilder &) = delete;
+
+    // a table not finished is removed
+    ~TableBuilder();
+
+    // keys must be added in increasing order
+    void add(uint64_t key, std::string_view value, bool deleted);
+
+    /**
+     * Write the remaining data block, the filter block, the meta block, the index block and the footer,
+     * sync the file and rename it into place. Returns nullptr if the table cannot be written.
+     */
+    std::shared_ptr<IndexTable> finish();
+
+    // the filter is sized by the number of keys, so it is built by finish()
+    [[nodiscard]] std::shared_ptr<BloomFilter> get_filter() const { return filter_; }
+
+    // nullptr if the table has no range filter
+    [[nodiscard]] std::shared_ptr<RangeFilter> get_range_filter() const { return range_filter_; }
+
+    [[nodiscard]] uint64_t get_file_size() const { return offset_ + block_.size(); }
+
+    [[nodiscard]] bool empty() const { return size_ == 0U; }
+
+    static const uint64_t BLOCK_SIZE = 4U * 1024U; // 4KB
+
+    // blocks are written to the file in chunks of this size
+    static const uint64_t WRITE_BUFFER_SIZE = 1024U * 1024U; // 1MB
+
+    // the name a table is written under until it is finished
+    static std::string temp_path(const std::string &path) { return path + ".tmp"; }
+
+private:
+    std::string path_;
+    int fd_;
+    // false once a write failed
+    bool ok_;
+    std::string buffer_;
+    std::string block_;
+    uint64_t offset_{0U};
+    uint64_t min_key_{0U};
+    uint64_t max_key_{0U};
+    uint64_t size_{0U};
+    std::vector<IndexNode> nodes_;
+    std::vector<uint64_t> hashes_;
+    uint32_t bits_per_key_;
+    BloomKind kind_;
+    std::shared_ptr<BloomFilter> filter_;
+    uint32_t range_shift_;
+    uint32_t range_bits_per_prefix_;
+    // the first key of every prefix of the range filter
+    std::vector<uint64_t> prefix_keys_;
+    std::shared_ptr<RangeFilter> range_filter_;
+
+    void flush_block();
+
+    void append(std::string_view data);
+
+    void write_buffer();
+};
+
+class TableReader {
+public:
+    /**
+     * Read the footer, the meta block and the index block of an sstable.
+     * The filter block is left on disk, only its location is returned.
+     * Returns nullptr if the file is not a complete sstable.
+     */
+    static std::shared_ptr<IndexTable> open(const std::string &path, uint64_t &filter_offset, uint64_t &filter_length);
+
+    static const uint64_t FOOTER_SIZE = 7U * sizeof(uint64_t);
+
+    static const uint64_t MAGIC = 0x6c736d2d6b763036U; // "lsm-kv06"
+};
+
+/**
+ * A decoded data block. The records either live in a buffer owned by the block,
+ * or in memory kept alive by an owner, such as a mapped sstable.
+ * Records are decoded into parallel arrays, so a search only walks the packed keys.
+ * Offsets and lengths are relative to the block and fit in 32 bits.
+ */
+class Block {
+public:
+    explicit Block(std::string data);
+
+    Block(std::string_view data, std::shared_ptr<const void> owner);
+
+    // the value refers to the memory of the block
+    [[nodiscard]] bool get(uint64_t key, std::string_view &value, bool &deleted) const;
+
+    // number of records in the block
+    [[nodiscard]] size_t size() const { return keys_.size(); }
+
+    // index of the first record whose key >= target
+    [[nodiscard]] size_t lower_bound(uint64_t target) const;
+
+    [[nodiscard]] uint64_t key(size_t i) const { return keys_[i]; }
+
+    [[nodiscard]] std::string_view value(size_t i) const { return data_.substr(offsets_[i], lengths_[i]); }
+
+    [[nodiscard]] bool is_deleted(size_t i) const { return deleted_[i] != 0U; }
+
+    // bytes held by the decoded block
+    [[nodiscard]] size_t get_memory_usage() const {
+        return buffer_.capacity() + keys_.capacity() * sizeof(uint64_t) +
+               (offsets_.capacity() + lengths_.capacity()) * sizeof(uint32_t) + deleted_.capacity();
+    }
+
+private:
+    std::string buffer_;
+    std::shared_ptr<const void> owner_;
+    std::string_view data_;
+    std::vector<uint64_t> keys_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    std::vector<uint8_t> deleted_;
+
+    void decode();
+};
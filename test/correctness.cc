@@ -53,22 +53,101 @@ private:
         report();
     }
 
+    static std::string binary_value(uint64_t i) {
+        std::string s(i + 1U, 'b');
+        for (uint64_t j = 0U; j < s.size(); j += 3U) {
+            s[j] = '\0';
+        }
+        return s;
+    }
+
+    void binary_test(uint64_t max) {
+        uint64_t i;
+        const uint64_t base = 1ULL << 32U;
+
+        // Test values containing NUL bytes
+        for (i = 0U; i < max; ++i) {
+            store.put(base + i, binary_value(i));
+            EXPECT(binary_value(i), store.get(base + i));
+        }
+        phase();
+
+        // Test after all insertions, most of them have been flushed to sstables
+        for (i = 0U; i < max; ++i) {
+            EXPECT(binary_value(i), store.get(base + i));
+        }
+        phase();
+
+        // Test pinned values
+        PinnableValue value;
+        for (i = 0U; i < max; ++i) {
+            EXPECT(true, store.get(base + i, value));
+            EXPECT(binary_value(i), value.to_string());
+        }
+        EXPECT(false, store.get(base + max, value));
+        EXPECT(true, value.empty());
+        phase();
+
+        report();
+    }
+
+    void compaction_test(uint64_t max) {
+        uint64_t i;
+
+        // Test large values over compacted tables
+        write_compacted("data", max);
+        for (i = 0U; i < max; ++i) {
+            EXPECT(large_value(i), store.get(i));
+        }
+        phase();
+
+        // Test updates and deletions over the compacted tables
+        for (i = 0U; i < max; i += 2U) {
+            store.put(i, std::string(i + 1U, 'c'));
+        }
+        for (i = 1U; i < max; i += 4U) {
+            EXPECT(true, store.del(i));
+        }
+        for (i = 0U; i < max; ++i) {
+            switch (i & 3U) {
+                case 1U:
+                    EXPECT(not_found, store.get(i));
+                    break;
+                case 3U:
+                    EXPECT(large_value(i), store.get(i));
+                    break;
+                default:
+                    EXPECT(std::string(i + 1U, 'c'), store.get(i));
+            }
+        }
+        phase();
+
+        report();
+    }
+
 public:
-    explicit CorrectnessTest(const std::string &dir, bool v = true)
-            : Test(dir, v) {
+    CorrectnessTest(const std::string &dir, const Options &options, bool v = true)
+            : Test(dir, options, v) {
     }
 
     void start_test(void *args = nullptr) override {
         std::cout << "KVStore Correctness Test" << std::endl;
         fs::path path = "data";
-        (void) fs::remove_all(path);
+        clean(path);
 
         std::cout << "[Simple Test]" << std::endl;
         regular_test(SIMPLE_TEST_MAX);
-        (void) fs::remove_all(path);
+        clean(path);
 
         std::cout << "[Large Test]" << std::endl;
         regular_test(LARGE_TEST_MAX);
+
+        std::cout << "[Binary Test]" << std::endl;
+        binary_test(LARGE_TEST_MAX);
+        clean(path);
+
+        std::cout << "[Compaction Test]" << std::endl;
+        compaction_test(COMPACTION_TEST_MAX);
     }
 };
 
@@ -81,11 +160,16 @@ int main(int argc, char *argv[]) {
     std::cout << std::endl;
     (void) std::cout.flush();
 
-    (void) fs::remove_all("data");
+    bool passed = true;
+    for (auto &[name, options]: store_configurations()) {
+        std::cout << "<<" << name << ">>" << std::endl;
+        (void) fs::remove_all("data");
 
-    CorrectnessTest test("data", verbose);
+        CorrectnessTest test("data", options, verbose);
 
-    test.start_test();
+        test.start_test();
+        passed = passed && test.all_passed();
+    }
 
-    return 0;
+    return passed ? 0 : 1;
 }
@@ -3,6 +3,8 @@
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <utility>
+#include <vector>
 
 #include "test.h"
 
@@ -11,6 +13,21 @@ namespace fs = std::filesystem;
 class PersistenceTest : public Test {
 private:
     const uint64_t TEST_MAX = 1024U * 2U;
+    const uint64_t SCAN_WIDTH = 16U;
+
+    const std::string dir;
+
+    [[nodiscard]] std::string expected(uint64_t i) const {
+        switch (i & 3U) {
+            case 0U:
+            case 1U:
+                return std::string(i + 1U, 't');
+            case 2U:
+                return not_found;
+            default:
+                return std::string(i + 1U, 's');
+        }
+    }
 
     void prepare(uint64_t max) {
         uint64_t i;
@@ -103,12 +120,36 @@ private:
 
         phase();
 
+        // Test scans, which read the filter blocks of the recovered tables
+        std::vector<std::pair<uint64_t, std::string>> result;
+        for (i = 0U; i < max; i += SCAN_WIDTH) {
+            store.scan(i, i + SCAN_WIDTH - 1U, result);
+            size_t j = 0U;
+            for (uint64_t key = i; key < i + SCAN_WIDTH; ++key) {
+                if (expected(key).empty()) {
+                    continue;
+                }
+                EXPECT(true, j < result.size());
+                if (j < result.size()) {
+                    EXPECT(key, result[j].first);
+                    EXPECT(expected(key), result[j].second);
+                }
+                ++j;
+            }
+            EXPECT(j, result.size());
+        }
+        // past the last key
+        store.scan(max, max + SCAN_WIDTH, result);
+        EXPECT(true, result.empty());
+
+        phase();
+
         report();
     }
 
 public:
-    PersistenceTest(const std::string &dir, bool v = true)
-            : Test(dir, v) {
+    PersistenceTest(const std::string &dir, const Options &options, bool v = true)
+            : Test(dir, options, v), dir(dir) {
     }
 
     void start_test(void *args = nullptr) override {
@@ -119,9 +160,9 @@ public:
         if (testmode) {
             std::cout << "<<Test Mode>>" << std::endl;
             test(TEST_MAX);
-            (void) fs::remove_all("data");
+            clean(dir);
         } else {
-            (void) fs::remove_all("data");
+            clean(dir);
             std::cout << "<<Preparation Mode>>" << std::endl;
             prepare(TEST_MAX);
         }
@@ -162,9 +203,17 @@ int main(int argc, char *argv[]) {
     }
     usage(argv[0], verbose ? "ON" : "OFF", testmode ? "Test Mode" : "Preparation Mode");
 
-    PersistenceTest test("data", verbose);
+    PersistenceTest test("data", Options(), verbose);
 
     test.start_test(static_cast<void *>(&testmode));
 
-    return 0;
+    // the range filters of the tables written by the preparation are loaded from their filter blocks
+    Options range_filter;
+    range_filter.range_filter_shift = 8U;
+    std::cout << "<<Range Filter>>" << std::endl;
+    PersistenceTest range_filter_test("range", range_filter, verbose);
+
+    range_filter_test.start_test(static_cast<void *>(&testmode));
+
+    return test.all_passed() && range_filter_test.all_passed() ? 0 : 1;
 }
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cstdint>
+#include <filesystem>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "../kvstore.h"
 
@@ -43,6 +46,7 @@ protected:
             ++nr_passed_phases;
             std::cout << "[PASS]" << std::endl;
         } else {
+            passed = false;
             std::cout << "[FAIL]" << std::endl;
         }
 
@@ -66,9 +70,40 @@ protected:
 
     bool verbose;
 
+    // remove the files of the store once its background flushes and compactions are done,
+    // which would write into the directory while it is removed
+    void clean(const std::filesystem::path &path) {
+        store.reset();
+        (void) std::filesystem::remove_all(path);
+    }
+
+    // enough 4KB values for level 0 to be compacted while they are written
+    const uint64_t COMPACTION_TEST_MAX = 1024U * 3U;
+    const uint64_t COMPACTION_VALUE_SIZE = 4096U;
+
+    [[nodiscard]] std::string large_value(uint64_t i) const {
+        return std::string(COMPACTION_VALUE_SIZE, static_cast<char>('a' + i % 26U));
+    }
+
+    // write large values to the keys below max, the later memtables wait for the flush that compacts level 0,
+    // and expect level 1 of the store at path to hold tables
+    void write_compacted(const std::filesystem::path &path, uint64_t max) {
+        for (uint64_t i = 0U; i < max; ++i) {
+            store.put(i, large_value(i));
+        }
+        EXPECT(true, std::filesystem::exists(path / "1") && !std::filesystem::is_empty(path / "1"));
+    }
+
+    // false once a phase failed
+    bool passed = true;
+
 public:
     explicit Test(const std::string &dir, bool v = true)
-            : store(dir), verbose(v) {
+            : Test(dir, Options(), v) {
+    }
+
+    Test(const std::string &dir, const Options &options, bool v = true)
+            : store(dir, options), verbose(v) {
         nr_tests = 0U;
         nr_passed_tests = 0U;
         nr_phases = 0U;
@@ -78,6 +113,34 @@ public:
     virtual void start_test(void *args = nullptr) {
         std::cout << "No test is implemented." << std::endl;
     }
+
+    // the exit status of the test program
+    [[nodiscard]] bool all_passed() const { return passed; }
 };
 
 const std::string Test::not_found;
+
+// the options the store tests run with, each on a store of its own
+std::vector<std::pair<std::string, Options>> store_configurations() {
+    std::vector<std::pair<std::string, Options>> configurations;
+    (void) configurations.emplace_back("default", Options());
+
+    Options mmap;
+    mmap.use_mmap = true;
+    (void) configurations.emplace_back("mmap", mmap);
+
+    Options hash_linklist;
+    hash_linklist.memtable_kind = MemTableKind::HASH_LINKLIST;
+    (void) configurations.emplace_back("hash linked list", hash_linklist);
+
+    Options art;
+    art.memtable_kind = MemTableKind::ART;
+    (void) configurations.emplace_back("adaptive radix tree", art);
+
+    // scans skip the tables whose range filter holds no prefix of their range
+    Options range_filter;
+    range_filter.range_filter_shift = 8U;
+    (void) configurations.emplace_back("range filter", range_filter);
+
+    return configurations;
+}
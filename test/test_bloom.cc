@@ -1,20 +1,48 @@
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <string>
 
 #include "../bloom.h"
+#include "../table.h"
 #include "test.h"
 
+namespace fs = std::filesystem;
+
 class BloomTest : public Test {
 private:
     const uint64_t SIMPLE_TEST_MAX = 512U;
     const uint64_t MIDDLE_TEST_MAX = 1024U * 64U;
     const uint64_t LARGE_TEST_MAX = 1024U * 1024U * 8U;
+    const uint32_t BITS_PER_KEY = 10U;
+    // about 4 bits per key for the keys of the budget test, written down to level 3
+    const uint64_t BUDGET_TEST_MAX = 1024U * 160U;
+    const uint64_t BUDGET_VALUE_SIZE = 256U;
+    const size_t BLOOM_BUDGET = 80U * 1024U;
+    // 16 keys per prefix, the range filters of the budget test are probed past the last prefix of each table
+    const uint32_t BUDGET_RANGE_SHIFT = 4U;
+    const uint64_t RANGE_PROBES = 256U;
 
-    BloomFilter bloomFilter{};
+    // number of keys in [max, 2 * max) a filter of [0, max) reports as present
+    uint64_t false_positives(uint64_t max, BloomKind kind) {
+        uint64_t i;
+        BloomFilter bloomFilter(max, BITS_PER_KEY, kind);
+        for (i = 0U; i < max; ++i) {
+            bloomFilter.add(i);
+        }
+        uint64_t positives = 0U;
+        for (i = max; i < 2U * max; ++i) {
+            positives += bloomFilter.contains(i) ? 1U : 0U;
+        }
+        return positives;
+    }
 
-    void regular_test(uint64_t max) {
+    void regular_test(uint64_t max, BloomKind kind) {
         uint64_t i;
+        // sized for the keys it will hold
+        BloomFilter bloomFilter(max, BITS_PER_KEY, kind);
 
         // Test a single key
         EXPECT(false, bloomFilter.contains(1U));
@@ -38,6 +66,26 @@ private:
         }
         phase();
 
+        // Test false positives, about 1% with 10 bits per key
+        uint64_t positives = 0U;
+        for (i = max; i < 2U * max; ++i) {
+            positives += bloomFilter.contains(i) ? 1U : 0U;
+        }
+        EXPECT(true, positives * 50U <= max);
+        phase();
+
+        // Test encoding
+        std::string encoded;
+        bloomFilter.encode(encoded);
+        BloomFilter decoded(encoded);
+        EXPECT(bloomFilter.get_m(), decoded.get_m());
+        EXPECT(bloomFilter.get_k(), decoded.get_k());
+        EXPECT(static_cast<int>(bloomFilter.get_kind()), static_cast<int>(decoded.get_kind()));
+        for (i = 0U; i < 2U * max; ++i) {
+            EXPECT(bloomFilter.contains(i), decoded.contains(i));
+        }
+        phase();
+
         bloomFilter.reset();
 
         // Test after reset
@@ -49,6 +97,139 @@ private:
         report();
     }
 
+    void range_test(uint64_t max) {
+        uint64_t i;
+        const uint32_t shift = 8U;
+        // every other prefix holds a key
+        RangeFilter rangeFilter(shift, max, BITS_PER_KEY);
+        for (i = 0U; i < max; ++i) {
+            rangeFilter.add((2U * i) << shift);
+        }
+
+        // Test ranges holding a key
+        for (i = 0U; i < max; ++i) {
+            EXPECT(true, rangeFilter.may_contain((2U * i) << shift, (2U * i) << shift));
+            EXPECT(true, rangeFilter.may_contain(((2U * i + 1U) << shift) - 1U, ((2U * i + 1U) << shift) + 1U));
+        }
+        phase();
+
+        // Test ranges between keys, about 1% false positives with 10 bits per prefix
+        uint64_t positives = 0U;
+        for (i = 0U; i < max; ++i) {
+            positives += rangeFilter.may_contain((2U * i + 1U) << shift, ((2U * i + 2U) << shift) - 1U) ? 1U : 0U;
+        }
+        EXPECT(true, positives * 50U <= max);
+        phase();
+
+        // Test wide ranges
+        EXPECT(true, rangeFilter.may_contain(0U, UINT64_MAX));
+        EXPECT(false, rangeFilter.may_contain(1U, 0U));
+        phase();
+
+        // Test encoding
+        std::string encoded;
+        rangeFilter.encode(encoded);
+        RangeFilter decoded(encoded);
+        EXPECT(rangeFilter.get_shift(), decoded.get_shift());
+        for (i = 0U; i < 2U * max; ++i) {
+            EXPECT(rangeFilter.may_contain(i << shift, i << shift), decoded.may_contain(i << shift, i << shift));
+        }
+        phase();
+
+        report();
+    }
+
+    void compare_test(uint64_t max) {
+        uint64_t standard = false_positives(max, BloomKind::STANDARD);
+        uint64_t blocked = false_positives(max, BloomKind::BLOCKED);
+        std::cout << "  false positives: standard " << standard << ", blocked " << blocked
+                  << " of " << max << std::endl;
+
+        // Test the blocked filter stays close to the standard one
+        EXPECT(true, blocked <= 2U * standard + max / 100U);
+        phase();
+
+        report();
+    }
+
+    void budget_test(uint64_t max) {
+        uint64_t i;
+        const std::string dir = "budget";
+        (void) fs::remove_all(dir);
+        Options options;
+        options.bloom_memory_budget = BLOOM_BUDGET;
+        options.range_filter_shift = BUDGET_RANGE_SHIFT;
+        {
+            KVStore budgeted(dir, options);
+            for (i = 0U; i < max; ++i) {
+                budgeted.put(i, std::string(BUDGET_VALUE_SIZE, 's'));
+            }
+            // the flushes and compactions are done once it is destroyed
+        }
+
+        // filter bytes and keys of every level, read from the tables
+        std::map<int, std::pair<uint64_t, uint64_t>> levels;
+        uint64_t nr_tables = 0U;
+        uint64_t total = 0U;
+        // prefixes past the keys of their table the range filters report as present
+        uint64_t range_false_positives = 0U;
+        for (auto &p: fs::recursive_directory_iterator(dir)) {
+            if (fs::is_directory(p) || p.path().parent_path() == fs::path(dir)) {
+                continue;
+            }
+            uint64_t filter_offset = 0U;
+            uint64_t filter_length = 0U;
+            std::shared_ptr<IndexTable> table = TableReader::open(p.path().string(), filter_offset, filter_length);
+            EXPECT(true, table != nullptr);
+            if (table == nullptr) {
+                continue;
+            }
+            // the bloom filter is followed by the range filter, which is not part of the budget
+            std::string block(filter_length, '\0');
+            std::ifstream file(p.path(), std::ios::in | std::ios::binary);
+            (void) file.seekg(static_cast<std::streamoff>(filter_offset));
+            (void) file.read(block.data(), static_cast<std::streamsize>(block.size()));
+            const uint64_t bloom_length = BloomFilter::encoded_length(block);
+            EXPECT(true, bloom_length > 0U && bloom_length < filter_length);
+            RangeFilter rangeFilter(std::string_view(block).substr(bloom_length));
+            const uint64_t last = table->get_max_key() >> BUDGET_RANGE_SHIFT;
+            for (i = 1U; i <= RANGE_PROBES; ++i) {
+                const uint64_t prefix = (last + i) << BUDGET_RANGE_SHIFT;
+                range_false_positives += rangeFilter.may_contain(prefix, prefix) ? 1U : 0U;
+            }
+            auto &[bytes, keys] = levels[std::stoi(p.path().parent_path().filename().string())];
+            bytes += bloom_length;
+            keys += table->get_size();
+            total += bloom_length;
+            ++nr_tables;
+        }
+
+        // Test shallow levels get at least as many bits per key as deeper ones
+        EXPECT(true, levels.size() >= 3U);
+        double previous = static_cast<double>(UINT32_MAX);
+        for (auto &[level, usage]: levels) {
+            const double bits = 8.0 * static_cast<double>(usage.first) / static_cast<double>(usage.second);
+            std::cout << "  level " << level << ": " << bits << " bits per key" << std::endl;
+            EXPECT(true, bits <= previous);
+            previous = bits;
+        }
+        phase();
+
+        // Test the filters fit the budget, up to the rounding of each one to a cache line and its header
+        std::cout << "  " << total << " bytes of filters for a budget of " << BLOOM_BUDGET << std::endl;
+        EXPECT(true, total <= BLOOM_BUDGET + nr_tables * 128U);
+        phase();
+
+        // Test the range filters keep their bits per prefix on the levels whose bloom filters get few bits
+        const double rate = static_cast<double>(range_false_positives) / static_cast<double>(nr_tables * RANGE_PROBES);
+        std::cout << "  range filter false positive rate: " << rate << std::endl;
+        EXPECT(true, rate < 0.05);
+        phase();
+
+        report();
+        (void) fs::remove_all(dir);
+    }
+
 public:
     explicit BloomTest(const std::string &dir, bool v = true)
             : Test(dir, v) {
@@ -57,14 +238,28 @@ public:
     void start_test(void *args = nullptr) override {
         std::cout << "Bloom filter Test" << std::endl;
 
-        std::cout << "[Simple Test]" << std::endl;
-        regular_test(SIMPLE_TEST_MAX);
+        for (BloomKind kind: {BloomKind::STANDARD, BloomKind::BLOCKED}) {
+            std::cout << (kind == BloomKind::STANDARD ? "[Standard]" : "[Blocked]") << std::endl;
+
+            std::cout << "[Simple Test]" << std::endl;
+            regular_test(SIMPLE_TEST_MAX, kind);
+
+            std::cout << "[Middle Test]" << std::endl;
+            regular_test(MIDDLE_TEST_MAX, kind);
+
+            std::cout << "[Large Test]" << std::endl;
+            regular_test(LARGE_TEST_MAX, kind);
+        }
+
+        std::cout << "[Range Test]" << std::endl;
+        range_test(MIDDLE_TEST_MAX);
 
-        std::cout << "[Middle Test]" << std::endl;
-        regular_test(MIDDLE_TEST_MAX);
+        std::cout << "[Compare Test]" << std::endl;
+        compare_test(MIDDLE_TEST_MAX);
+        compare_test(LARGE_TEST_MAX);
 
-        std::cout << "[Large Test]" << std::endl;
-        regular_test(LARGE_TEST_MAX);
+        std::cout << "[Budget Test]" << std::endl;
+        budget_test(BUDGET_TEST_MAX);
     }
 };
 
@@ -81,5 +276,5 @@ int main(int argc, char *argv[]) {
 
     test.start_test();
 
-    return 0;
+    return test.all_passed() ? 0 : 1;
 }
@@ -52,21 +52,82 @@ private:
         report();
     }
 
+    void sparse_test(uint64_t max) {
+        uint64_t i;
+        std::vector<std::pair<uint64_t, std::string>> result;
+        const uint64_t stride = 1ULL << 40U;
+
+        // Test scan over a range much wider than the number of keys
+        for (i = 1U; i <= max; ++i) {
+            store.put(i * stride, std::string(i, 's'));
+        }
+        store.scan(stride, UINT64_MAX, result);
+        EXPECT(max, (uint64_t) result.size());
+        for (i = 0U; i < result.size(); ++i) {
+            EXPECT((i + 1U) * stride, result[i].first);
+            EXPECT(std::string(i + 1U, 's'), result[i].second);
+        }
+        phase();
+
+        // Test scan with bounds between keys
+        store.scan(stride + 1U, 3U * stride - 1U, result);
+        EXPECT((uint64_t) 1U, (uint64_t) result.size());
+        EXPECT(2U * stride, result.empty() ? 0U : result[0].first);
+        phase();
+
+        report();
+    }
+
+    void compaction_test(uint64_t max) {
+        uint64_t i;
+        std::vector<std::pair<uint64_t, std::string>> result;
+
+        // Test scan over compacted tables
+        write_compacted("data", max);
+        store.scan(0U, max, result);
+        EXPECT(max, (uint64_t) result.size());
+        for (i = 0U; i < result.size(); ++i) {
+            EXPECT(i, result[i].first);
+            EXPECT(large_value(i), result[i].second);
+        }
+        phase();
+
+        // Test scan after deleting a half of key-value pairs
+        for (i = 0U; i < max; i += 2U) {
+            (void) store.del(i);
+        }
+        store.scan(0U, max, result);
+        EXPECT(max / 2U, (uint64_t) result.size());
+        for (i = 0U; i < result.size(); ++i) {
+            EXPECT(2U * i + 1U, result[i].first);
+        }
+        phase();
+
+        report();
+    }
+
 public:
-    explicit ScanTest(const std::string &dir, bool v = true)
-            : Test(dir, v) {
+    ScanTest(const std::string &dir, const Options &options, bool v = true)
+            : Test(dir, options, v) {
     }
 
     void start_test(void *args = nullptr) override {
         std::cout << "KVStore Scan Test" << std::endl;
-        (void) fs::remove_all("data");
+        clean("data");
 
         std::cout << "[Simple Test]" << std::endl;
         regular_test(SIMPLE_TEST_MAX);
-        (void) fs::remove_all("data");
+        clean("data");
 
         std::cout << "[Large Test]" << std::endl;
         regular_test(LARGE_TEST_MAX);
+
+        std::cout << "[Sparse Test]" << std::endl;
+        sparse_test(LARGE_TEST_MAX);
+        clean("data");
+
+        std::cout << "[Compaction Test]" << std::endl;
+        compaction_test(COMPACTION_TEST_MAX);
     }
 };
 
@@ -79,11 +140,16 @@ int main(int argc, char *argv[]) {
     std::cout << std::endl;
     (void) std::cout.flush();
 
-    (void) fs::remove_all("data");
+    bool passed = true;
+    for (auto &[name, options]: store_configurations()) {
+        std::cout << "<<" << name << ">>" << std::endl;
+        (void) fs::remove_all("data");
 
-    ScanTest test("data", verbose);
+        ScanTest test("data", options, verbose);
 
-    test.start_test();
+        test.start_test();
+        passed = passed && test.all_passed();
+    }
 
-    return 0;
+    return passed ? 0 : 1;
 }
@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "test.h"
+
+namespace fs = std::filesystem;
+
+class WalTest : public Test {
+private:
+    const uint64_t CONCURRENT_TEST_MAX = 8U;
+    const uint64_t NR_THREADS = 4U;
+    const uint64_t NR_WRITES = 64U;
+    const uint64_t NR_ROUNDS = 1024U;
+    const uint64_t VALUE_SIZE = 128U;
+    const uint64_t TORN_TEST_MAX = 256U;
+    const uint64_t REUSE_TEST_MAX = 4096U;
+    const uint64_t SYNC_TEST_MAX = 1024U * 4U;
+    const uint32_t SYNC_INTERVAL_MS = 2U;
+    const uint64_t FAILED_FLUSH_TEST_MAX = 4096U;
+    const uint64_t LARGE_VALUE_SIZE = 4096U;
+
+    // the stores of the tests are reopened, so they live in a directory of their own
+    const std::string dir = "wal";
+
+    [[nodiscard]] std::string thread_value(uint64_t thread, uint64_t i) const {
+        std::string s = std::to_string(thread) + ":" + std::to_string(i);
+        s.resize(VALUE_SIZE, 'w');
+        return s;
+    }
+
+    // the live segment with the latest sequence number, empty if there is none
+    [[nodiscard]] std::string newest_segment() const {
+        std::string newest;
+        uint64_t seq = 0U;
+        for (auto &entry: fs::directory_iterator(dir)) {
+            if (entry.path().filename().string().rfind("wal.", 0U) != 0U) {
+                continue;
+            }
+            WalReader reader(entry.path().string());
+            if (reader.is_live() && reader.get_seq() >= seq) {
+                seq = reader.get_seq();
+                newest = entry.path().string();
+            }
+        }
+        return newest;
+    }
+
+    // write the keys below max into a store, which leaves them in one segment of records of the same size
+    void write_segment(uint64_t max) {
+        (void) fs::remove_all(dir);
+        KVStore written(dir);
+        for (uint64_t i = 0U; i < max; ++i) {
+            written.put(i, thread_value(0U, i));
+        }
+    }
+
+    // reopen the store, expect the keys below recovered and none of the others, then write them again
+    void check_recovered(uint64_t max, uint64_t recovered) {
+        uint64_t i;
+        {
+            KVStore store(dir);
+            for (i = 0U; i < max; ++i) {
+                EXPECT(i < recovered ? thread_value(0U, i) : std::string(), store.get(i));
+            }
+            // the store writes a segment of its own after the records it dropped
+            for (i = recovered; i < max; ++i) {
+                store.put(i, thread_value(0U, i));
+            }
+        }
+        KVStore reopened(dir);
+        for (i = 0U; i < max; ++i) {
+            EXPECT(thread_value(0U, i), reopened.get(i));
+        }
+    }
+
+    void torn_test(uint64_t max) {
+        const uint64_t record_size = WAL_HEADER_SIZE + VALUE_SIZE;
+        // Test a segment torn within its last record is recovered up to the record before it
+        write_segment(max);
+        fs::resize_file(newest_segment(), WAL_SEGMENT_HEADER_SIZE + (max - 1U) * record_size + record_size / 2U);
+        check_recovered(max, max - 1U);
+        phase();
+
+        // Test a segment torn between two records is recovered up to the tear
+        write_segment(max);
+        fs::resize_file(newest_segment(), WAL_SEGMENT_HEADER_SIZE + (max / 2U) * record_size);
+        check_recovered(max, max / 2U);
+        phase();
+
+        // Test a corrupted record is dropped with every record after it
+        write_segment(max);
+        {
+            std::fstream segment(newest_segment(), std::ios::in | std::ios::out | std::ios::binary);
+            (void) segment.seekp(static_cast<std::streamoff>(
+                                         WAL_SEGMENT_HEADER_SIZE + (max / 2U) * record_size + WAL_HEADER_SIZE));
+            (void) segment.put('x');
+        }
+        check_recovered(max, max / 2U);
+        phase();
+
+        report();
+    }
+
+    // the number of wal segments, and the largest number of their files
+    void count_segments(uint64_t &nr_segments, uint64_t &last) const {
+        nr_segments = 0U;
+        last = 0U;
+        for (auto &entry: fs::directory_iterator(dir)) {
+            const std::string name = entry.path().filename().string();
+            if (name.rfind("wal.", 0U) == 0U) {
+                ++nr_segments;
+                last = std::max<uint64_t>(last, std::stoull(name.substr(4U)));
+            }
+        }
+    }
+
+    void reuse_test(uint64_t max) {
+        uint64_t i;
+        uint64_t nr_segments = 0U;
+        uint64_t last = 0U;
+        Options options;
+        // a segment for the mutable memtable, one per queued memtable and as many released ones
+        const uint64_t max_segments = 2U * options.max_immutable_memtables + 1U;
+        // Test the segments released by the flushes are reused
+        (void) fs::remove_all(dir);
+        {
+            KVStore written(dir, options);
+            for (i = 0U; i < max; ++i) {
+                written.put(i, std::string(LARGE_VALUE_SIZE, static_cast<char>('a' + i % 26U)));
+            }
+        }
+        count_segments(nr_segments, last);
+        EXPECT(true, nr_segments <= max_segments);
+        EXPECT(true, last <= max_segments);
+        {
+            KVStore recovered(dir, options);
+            for (i = 0U; i < max; ++i) {
+                EXPECT(std::string(LARGE_VALUE_SIZE, static_cast<char>('a' + i % 26U)), recovered.get(i));
+            }
+        }
+        phase();
+
+        // Test the records left in a reused segment by its previous use are not replayed.
+        // The segment of the first store is released by the flush of the second one, then reused by the third
+        // one, which overwrites the first record only: the stale second record follows a valid one
+        (void) fs::remove_all(dir);
+        {
+            KVStore first(dir, options);
+            first.put(0U, thread_value(1U, 0U));
+            first.put(1U, thread_value(1U, 1U));
+        }
+        {
+            KVStore second(dir, options);
+            second.put(1U, thread_value(2U, 1U));
+        }
+        {
+            KVStore third(dir, options);
+            third.put(0U, thread_value(3U, 0U));
+        }
+        // the third store reused the first segment, the second one is released by the flush of its records
+        count_segments(nr_segments, last);
+        EXPECT(static_cast<uint64_t>(2U), nr_segments);
+        EXPECT(static_cast<uint64_t>(2U), last);
+        {
+            KVStore recovered(dir, options);
+            EXPECT(thread_value(3U, 0U), recovered.get(0U));
+            EXPECT(thread_value(2U, 1U), recovered.get(1U));
+        }
+        phase();
+
+        report();
+    }
+
+    void concurrent_test(uint64_t max) {
+        uint64_t i;
+        // Test the wal replays the writes of a key in the order they were applied
+        for (uint64_t round = 0U; round < NR_ROUNDS; ++round) {
+            (void) fs::remove_all(dir);
+            std::vector<std::string> expected(max);
+            {
+                KVStore written(dir);
+                // the threads start together and write the same keys, the last writes race
+                std::atomic<bool> start{false};
+                std::vector<std::thread> threads;
+                for (uint64_t t = 0U; t < NR_THREADS; ++t) {
+                    threads.emplace_back([this, &written, &start, t, max]() {
+                        while (!start.load()) {
+                            std::this_thread::yield();
+                        }
+                        for (uint64_t j = 0U; j < NR_WRITES; ++j) {
+                            if (j % 7U == t) {
+                                (void) written.del(j % max);
+                            } else {
+                                written.put(j % max, thread_value(t, j));
+                            }
+                        }
+                    });
+                }
+                start.store(true);
+                for (auto &thread: threads) {
+                    thread.join();
+                }
+                for (i = 0U; i < max; ++i) {
+                    expected[i] = written.get(i);
+                }
+            }
+            KVStore recovered(dir);
+            for (i = 0U; i < max; ++i) {
+                EXPECT(expected[i], recovered.get(i));
+            }
+        }
+        phase();
+
+        report();
+    }
+
+    void sync_test(uint64_t max, WalSync sync) {
+        uint64_t i;
+        // Test the writes of concurrent writers are recovered under the sync policy
+        (void) fs::remove_all(dir);
+        Options options;
+        options.wal_sync = sync;
+        options.wal_sync_interval_ms = SYNC_INTERVAL_MS;
+        {
+            KVStore written(dir, options);
+            // the deletes that found no key, counted by the threads and checked once they are done
+            std::atomic<uint64_t> missed{0U};
+            std::vector<std::thread> threads;
+            for (uint64_t t = 0U; t < NR_THREADS; ++t) {
+                threads.emplace_back([this, &written, &missed, t, max]() {
+                    for (uint64_t j = t; j < max; j += NR_THREADS) {
+                        written.put(j, thread_value(t, j));
+                        // let the interval syncs run between the writes
+                        if (j % 256U == t) {
+                            std::this_thread::sleep_for(std::chrono::milliseconds(SYNC_INTERVAL_MS));
+                        }
+                    }
+                    for (uint64_t j = t; j < max; j += 2U * NR_THREADS) {
+                        if (!written.del(j)) {
+                            (void) missed.fetch_add(1U);
+                        }
+                    }
+                });
+            }
+            for (auto &thread: threads) {
+                thread.join();
+            }
+            EXPECT(static_cast<uint64_t>(0U), missed.load());
+            EXPECT(true, written.is_writable());
+        }
+        {
+            KVStore recovered(dir, options);
+            for (i = 0U; i < max; ++i) {
+                const bool deleted = i % (2U * NR_THREADS) < NR_THREADS;
+                EXPECT(deleted ? std::string() : thread_value(i % NR_THREADS, i), recovered.get(i));
+            }
+        }
+        phase();
+
+        report();
+    }
+
+    void failed_wal_test() {
+        // Test a write the wal cannot hold is refused, as well as the writes after it
+        (void) fs::remove_all(dir);
+        (void) fs::create_directories(dir);
+        // the released segment reused by the store is a device whose writes fail
+        const fs::path segment = fs::path(dir) / "wal.1";
+        fs::create_symlink("/dev/full", segment);
+        {
+            KVStore failed(dir);
+            failed.put(1U, "refused");
+            EXPECT(false, failed.is_writable());
+            EXPECT(std::string(), failed.get(1U));
+            failed.put(2U, "refused");
+            EXPECT(std::string(), failed.get(2U));
+            EXPECT(false, failed.del(1U));
+        }
+        phase();
+
+        (void) fs::remove(segment);
+        {
+            KVStore recovered(dir);
+            EXPECT(std::string(), recovered.get(1U));
+            recovered.put(1U, "written");
+            EXPECT(true, recovered.is_writable());
+        }
+        {
+            KVStore recovered(dir);
+            EXPECT("written", recovered.get(1U));
+        }
+        phase();
+
+        report();
+    }
+
+    void failed_flush_test(uint64_t max) {
+        uint64_t i;
+        uint64_t written_max = 0U;
+        // Test a memtable that cannot be flushed stays searched, and is recovered by the next start
+        (void) fs::remove_all(dir);
+        (void) fs::create_directories(dir);
+        // the directory of level 0 cannot be created over a file
+        const fs::path blocker = fs::path(dir) / "0";
+        std::ofstream(blocker).put('0');
+        {
+            KVStore failed(dir);
+            for (i = 0U; i < max && failed.is_writable(); ++i) {
+                failed.put(i, std::string(LARGE_VALUE_SIZE, static_cast<char>('a' + i % 26U)));
+            }
+            written_max = i;
+            EXPECT(false, failed.is_writable());
+            for (i = 0U; i < written_max; ++i) {
+                EXPECT(std::string(LARGE_VALUE_SIZE, static_cast<char>('a' + i % 26U)), failed.get(i));
+            }
+            // writes are refused
+            failed.put(written_max, "refused");
+            EXPECT(std::string(), failed.get(written_max));
+            EXPECT(false, failed.del(0U));
+            EXPECT(std::string(LARGE_VALUE_SIZE, 'a'), failed.get(0U));
+        }
+        phase();
+
+        (void) fs::remove(blocker);
+        {
+            KVStore recovered(dir);
+            EXPECT(true, recovered.is_writable());
+            for (i = 0U; i < written_max; ++i) {
+                EXPECT(std::string(LARGE_VALUE_SIZE, static_cast<char>('a' + i % 26U)), recovered.get(i));
+            }
+            EXPECT(std::string(), recovered.get(written_max));
+        }
+        // the recovered memtables are flushed
+        EXPECT(true, fs::is_directory(blocker) && !fs::is_empty(blocker));
+        phase();
+
+        report();
+    }
+
+    void failed_release_test(uint64_t max) {
+        uint64_t i;
+        std::string expected;
+        // Test a segment that cannot be released stops the later flushes, whose values it would hide once replayed
+        (void) fs::remove_all(dir);
+        const fs::path segment = fs::path(dir) / "wal.1";
+        const fs::path saved = fs::path(dir) / "saved";
+        {
+            KVStore failed(dir);
+            failed.put(0U, "old");
+            // the store keeps writing the segment it opened, while its release writes a device that fails
+            fs::rename(segment, saved);
+            fs::create_symlink("/dev/full", segment);
+            // the key is written again in a later memtable, until the release of the first one fails
+            for (i = 1U; i < max && failed.is_writable(); ++i) {
+                failed.put(i, std::string(LARGE_VALUE_SIZE, static_cast<char>('a' + i % 26U)));
+                if (i == max / 4U) {
+                    failed.put(0U, "new");
+                }
+            }
+            EXPECT(false, failed.is_writable());
+            expected = failed.get(0U);
+        }
+        phase();
+
+        // as if the release never reached the file
+        (void) fs::remove(segment);
+        fs::rename(saved, segment);
+        {
+            KVStore recovered(dir);
+            EXPECT(expected, recovered.get(0U));
+        }
+        // and once the recovered memtables are flushed
+        {
+            KVStore recovered(dir);
+            EXPECT(expected, recovered.get(0U));
+        }
+        phase();
+
+        report();
+    }
+
+public:
+    explicit WalTest(const std::string &dir, bool v = true)
+            : Test(dir, v) {
+    }
+
+    void start_test(void *args = nullptr) override {
+        std::cout << "KVStore WAL Test" << std::endl;
+
+        std::cout << "[Torn Test]" << std::endl;
+        torn_test(TORN_TEST_MAX);
+
+        std::cout << "[Reuse Test]" << std::endl;
+        reuse_test(REUSE_TEST_MAX);
+
+        std::cout << "[Concurrent Test]" << std::endl;
+        concurrent_test(CONCURRENT_TEST_MAX);
+
+        std::cout << "[Interval Sync Test]" << std::endl;
+        sync_test(SYNC_TEST_MAX, WalSync::INTERVAL);
+
+        std::cout << "[Every Commit Sync Test]" << std::endl;
+        sync_test(SYNC_TEST_MAX, WalSync::EVERY_COMMIT);
+
+        std::cout << "[Failed Wal Test]" << std::endl;
+        failed_wal_test();
+
+        std::cout << "[Failed Flush Test]" << std::endl;
+        failed_flush_test(FAILED_FLUSH_TEST_MAX);
+
+        std::cout << "[Failed Release Test]" << std::endl;
+        failed_release_test(FAILED_FLUSH_TEST_MAX);
+
+        (void) fs::remove_all(dir);
+    }
+};
+
+int main(int argc, char *argv[]) {
+    bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+    std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+    std::cout << "  -v: print extra info for failed tests [currently ";
+    std::cout << (verbose ? "ON" : "OFF") << "]" << std::endl;
+    std::cout << std::endl;
+    (void) std::cout.flush();
+
+    (void) fs::remove_all("data");
+
+    WalTest test("data", verbose);
+
+    test.start_test();
+
+    return test.all_passed() ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include "wal.h"
+#include "coding.h"
+#include "crc32c.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+const uint32_t WAL_LIVE_MAGIC = 0x4c41574cU;
+const uint32_t WAL_FREE_MAGIC = 0x4c415746U;
+
+// the crc of the records of a segment starts from the crc of its sequence number
+uint32_t seed(uint64_t seq) {
+    std::string buf;
+    put_fixed64(buf, seq);
+    return crc32c(buf.data(), buf.size());
+}
+
+std::string encode_header(uint32_t magic, uint64_t seq) {
+    std::string header;
+    put_fixed32(header, magic);
+    put_fixed64(header, seq);
+    put_fixed32(header, crc32c(header.data(), header.size()));
+    return header;
+}
+
+// false unless the header is intact
+bool decode_header(const char *p, uint32_t &magic, uint64_t &seq) {
+    const size_t length = WAL_SEGMENT_HEADER_SIZE - sizeof(uint32_t);
+    if (crc32c(p, length) != get_fixed32(p + length)) {
+        return false;
+    }
+    magic = get_fixed32(p);
+    seq = get_fixed64(p + sizeof(uint32_t));
+    return magic == WAL_LIVE_MAGIC || magic == WAL_FREE_MAGIC;
+}
+
+bool pwrite_all(int fd, const char *data, size_t n, uint64_t offset) {
+    size_t done = 0U;
+    while (done < n) {
+        ssize_t written = ::pwrite(fd, data + done, n - done, static_cast<off_t>(offset + done));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        done += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+}
+
+void encode_wal_record(std::string &dst, uint64_t seq, WalRecordType type, uint64_t key, std::string_view value) {
+    const size_t start = dst.size();
+    put_fixed32(dst, 0U); // crc, filled below
+    put_fixed32(dst, static_cast<uint32_t>(value.size()));
+    (void) dst.append(1U, static_cast<char>(type));
+    put_fixed64(dst, key);
+    (void) dst.append(value);
+    const uint32_t crc = crc32c(dst.data() + start + sizeof(uint32_t), dst.size() - start - sizeof(uint32_t),
+                                seed(seq));
+    (void) std::memcpy(dst.data() + start, &crc, sizeof(uint32_t));
+}
+
+bool release_wal_segment(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        // a removed segment is not replayed either
+        return errno == ENOENT;
+    }
+    char buf[WAL_SEGMENT_HEADER_SIZE];
+    uint32_t magic = 0U;
+    uint64_t seq = 0U;
+    // the sequence number is kept, so that the next ones stay larger after a restart
+    bool ok = ::pread(fd, buf, sizeof(buf), 0) == static_cast<ssize_t>(sizeof(buf)) &&
+              decode_header(buf, magic, seq);
+    if (ok) {
+        const std::string header = encode_header(WAL_FREE_MAGIC, seq);
+        ok = pwrite_all(fd, header.data(), header.size(), 0U) && ::fdatasync(fd) == 0;
+    }
+    (void) ::close(fd);
+    return ok;
+}
+
+WalReader::WalReader(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st{};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            data_ = static_cast<const char *>(mapping);
+            size_ = static_cast<uint64_t>(st.st_size);
+            // read once from the beginning to the end
+            (void) ::madvise(mapping, size_, MADV_SEQUENTIAL);
+        }
+    }
+    uint32_t magic = 0U;
+    uint64_t seq = 0U;
+    if (size_ >= WAL_SEGMENT_HEADER_SIZE && decode_header(data_, magic, seq)) {
+        seq_ = seq;
+        live_ = magic == WAL_LIVE_MAGIC;
+    }
+    // the records of a released segment are not read
+    offset_ = live_ ? WAL_SEGMENT_HEADER_SIZE : size_;
+    // the mapping outlives the descriptor
+    (void) ::close(fd);
+}
+
+WalReader::~WalReader() {
+    if (data_ != nullptr) {
+        (void) ::munmap(const_cast<char *>(data_), size_);
+    }
+}
+
+bool WalReader::next(WalRecordType &type, uint64_t &key, std::string_view &value) {
+    if (size_ - offset_ < WAL_HEADER_SIZE) {
+        return false;
+    }
+    const char *p = data_ + offset_;
+    const uint64_t length = get_fixed32(p + sizeof(uint32_t));
+    // zeros of the preallocated tail fail the crc as well
+    if (length > size_ - offset_ - WAL_HEADER_SIZE ||
+        crc32c(p + sizeof(uint32_t), WAL_HEADER_SIZE - sizeof(uint32_t) + length, seed(seq_)) != get_fixed32(p)) {
+        return false;
+    }
+    type = static_cast<WalRecordType>(p[2U * sizeof(uint32_t)]);
+    if (type != WalRecordType::PUT && type != WalRecordType::DEL) {
+        return false;
+    }
+    key = get_fixed64(p + 2U * sizeof(uint32_t) + 1U);
+    value = std::string_view(p + WAL_HEADER_SIZE, length);
+    offset_ += WAL_HEADER_SIZE + length;
+    return true;
+}
+
+WalWriter::WalWriter(WalSync sync, uint32_t sync_interval_ms) : sync_(sync), sync_interval_ms_(sync_interval_ms) {
+    if (sync_ == WalSync::INTERVAL) {
+        syncer_ = std::thread(&WalWriter::sync_periodically, this);
+    }
+}
+
+WalWriter::~WalWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    if (syncer_.joinable()) {
+        syncer_.join();
+    }
+    close();
+}
+
+bool WalWriter::open(const std::string &path, uint64_t seq, uint64_t size) {
+    close();
+    std::lock_guard<std::mutex> lock(mutex_);
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    ok_ = fd_ >= 0;
+    if (!ok_) {
+        return false;
+    }
+    seq_ = seq;
+    offset_ = WAL_SEGMENT_HEADER_SIZE;
+    struct stat st{};
+    if (::fstat(fd_, &st) == 0 && static_cast<uint64_t>(st.st_size) < size) {
+        // the file size is set once, so a sync of the records does not update it;
+        // a failure only costs that, the file grows as it is written
+        (void) ::fallocate(fd_, 0, 0, static_cast<off_t>(size));
+    }
+    // synced with the first records, and the records left after the header no longer match its seq
+    const std::string header = encode_header(WAL_LIVE_MAGIC, seq);
+    ok_ = pwrite_all(fd_, header.data(), header.size(), 0U);
+    dirty_ = true;
+    return ok_;
+}
+
+void WalWriter::close() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    // the records queued are written by the writers waiting for them, which hold no file of their own
+    cv_.wait(lock, [this]() { return !writing_ && written_ == appended_; });
+    if (fd_ < 0) {
+        return;
+    }
+    if (sync_ != WalSync::NONE && dirty_) {
+        (void) ::fdatasync(fd_);
+    }
+    (void) ::close(fd_);
+    fd_ = -1;
+    dirty_ = false;
+}
+
+bool WalWriter::append(std::string_view record) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    (void) pending_.append(record);
+    const uint64_t seq = ++appended_;
+    while (written_ < seq) {
+        if (writing_) {
+            cv_.wait(lock);
+            continue;
+        }
+        // lead a batch of every record queued so far
+        writing_ = true;
+        std::string batch;
+        batch.swap(pending_);
+        const uint64_t last = appended_;
+        lock.unlock();
+        bool ok = write_all(batch);
+        if (ok && sync_ == WalSync::EVERY_COMMIT) {
+            ok = ::fdatasync(fd_) == 0;
+        }
+        lock.lock();
+        ok_ = ok_ && ok;
+        dirty_ = dirty_ || sync_ != WalSync::EVERY_COMMIT;
+        written_ = last;
+        writing_ = false;
+        cv_.notify_all();
+    }
+    return ok_;
+}
+
+bool WalWriter::write_all(const std::string &batch) {
+    if (!pwrite_all(fd_, batch.data(), batch.size(), offset_)) {
+        return false;
+    }
+    offset_ += batch.size();
+    return true;
+}
+
+void WalWriter::sync_periodically() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stop_) {
+        (void) cv_.wait_for(lock, std::chrono::milliseconds(sync_interval_ms_), [this]() { return stop_; });
+        if (stop_ || !dirty_ || fd_ < 0) {
+            continue;
+        }
+        // wait for the batch being written, then keep the writers off the file while it is synced
+        cv_.wait(lock, [this]() { return !writing_ || stop_; });
+        if (stop_ || fd_ < 0) {
+            continue;
+        }
+        writing_ = true;
+        dirty_ = false;
+        lock.unlock();
+        const bool ok = ::fdatasync(fd_) == 0;
+        lock.lock();
+        ok_ = ok_ && ok;
+        writing_ = false;
+        cv_.notify_all();
+    }
+}
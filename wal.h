@@ -0,0 +1,134 @@
+/**
+ * The write-ahead log, split into segments of one memtable each:
+ *
+ * segment: header | record | record | ...
+ * header: magic(4) | sequence number(8) | crc(4)
+ * record: crc(4) | value length(4) | type(1) | key(8) | value
+ *
+ * Segments are preallocated and reused once their memtable is flushed, so that a sync writes data blocks
+ * only. The magic tells a live segment from a released one, and every segment gets a new sequence number.
+ * The crc of a record is the CRC32C of everything after it, seeded with the sequence number of its segment:
+ * recovery stops at a torn or corrupted record, as well as at the records left by a previous use of the file.
+ *
+ * The file stays open between records, and the records of concurrent writers are group-committed:
+ * the first writer to arrive writes every record queued meanwhile in one call, and syncs them at once
+ * if the policy asks for it, while the others wait for their record to be covered.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+enum class WalSync : uint8_t {
+    // records reach the page cache before append() returns, a crash of the machine may lose the latest ones
+    NONE = 0U,
+    // a background thread syncs the log every wal_sync_interval_ms
+    INTERVAL = 1U,
+    // records are synced before append() returns, one sync per group of concurrent writers
+    EVERY_COMMIT = 2U,
+};
+
+enum class WalRecordType : uint8_t {
+    PUT = 1U,
+    DEL = 2U,
+};
+
+const size_t WAL_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint32_t) + 1U + sizeof(uint64_t);
+
+const size_t WAL_SEGMENT_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t);
+
+// append a record of the segment seq to dst
+void encode_wal_record(std::string &dst, uint64_t seq, WalRecordType type, uint64_t key, std::string_view value);
+
+// mark the segment at path as released and sync it, so that its records are not replayed again;
+// false if it stays live
+bool release_wal_segment(const std::string &path);
+
+// scans the records of a segment mapped into memory
+class WalReader {
+public:
+    explicit WalReader(const std::string &path);
+
+    WalReader(const WalReader &) = delete;
+
+    WalReader &operator=(const WalReader &) = delete;
+
+    ~WalReader();
+
+    // the next record, false at the end of the segment or at the first torn or corrupted record.
+    // The value stays valid as long as the reader
+    bool next(WalRecordType &type, uint64_t &key, std::string_view &value);
+
+    // the sequence number of the segment, 0 if the file has no valid header
+    [[nodiscard]] uint64_t get_seq() const { return seq_; }
+
+    // the segment holds the records of a memtable not flushed yet
+    [[nodiscard]] bool is_live() const { return live_; }
+
+private:
+    const char *data_{nullptr};
+    uint64_t size_{0U};
+    uint64_t offset_{0U};
+    uint64_t seq_{0U};
+    bool live_{false};
+};
+
+class WalWriter {
+public:
+    WalWriter(WalSync sync, uint32_t sync_interval_ms);
+
+    WalWriter(const WalWriter &) = delete;
+
+    WalWriter &operator=(const WalWriter &) = delete;
+
+    ~WalWriter();
+
+    // start the segment seq in the file at path, preallocated to size bytes unless it is larger already;
+    // false if it cannot be opened
+    bool open(const std::string &path, uint64_t seq, uint64_t size);
+
+    // sync the records written unless the policy is NONE, then close the file
+    void close();
+
+    // returns once the record is written, and synced as the policy asks; false if it cannot be
+    bool append(std::string_view record);
+
+    // the sequence number of the open segment, the records appended must be encoded with it
+    [[nodiscard]] uint64_t get_seq() const { return seq_; }
+
+private:
+    const WalSync sync_;
+    const uint32_t sync_interval_ms_;
+
+    std::mutex mutex_;
+    // signalled when a batch is written, and to stop the sync thread
+    std::condition_variable cv_;
+    int fd_{-1};
+    uint64_t seq_{0U};
+    // where the next batch is written, only by the writer of the batch
+    uint64_t offset_{0U};
+    // records waiting for the next batch
+    std::string pending_;
+    // records are numbered as they are queued, those up to written_ are in the file
+    uint64_t appended_{0U};
+    uint64_t written_{0U};
+    // a writer or the sync thread is using the file, without the lock
+    bool writing_{false};
+    // records written since the last sync
+    bool dirty_{false};
+    // false once a write or a sync failed
+    bool ok_{true};
+    bool stop_{false};
+    std::thread syncer_;
+
+    bool write_all(const std::string &batch);
+
+    // the body of the sync thread of the INTERVAL policy
+    void sync_periodically();
+};